@@ -0,0 +1,113 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_set>
+
+#include "isosig.h"
+
+#include<triangulation/dim3.h>
+#include<triangulation/dim4.h>
+#include<triangulation/detail/triangulation.h>
+
+using namespace regina;
+class Batch {
+private:
+    //Signatures canonicalised per chunk; also the size of the reorder buffer
+    static const int chunkSize = 1 << 16;
+    Batch();
+
+    //Reads up to chunkSize signatures into chunk, returning false once nothing is left
+    static bool readChunk(std::istream& in, std::vector<std::string>& chunk) {
+        chunk.clear();
+        std::string name;
+        while ((int)chunk.size() < chunkSize && in >> name) {
+            chunk.emplace_back(name);
+        }
+        return chunk.size() > 0;
+    }
+
+    //Writes results in input order. Invalid signatures are left empty and written as
+    //!<input>, so every output line still matches its input, and reported on stderr.
+    //first is the position in the whole input of inputs[0], counting from 1.
+    static void writeChunk(std::ostream& out, const std::vector<std::string>& inputs,
+            std::vector<std::string>& results, int count, size_t first,
+            std::unordered_set<std::string>* seen) {
+        for (int i = 0; i < count; i++) {
+            if (results[i].size() == 0) {
+                std::cerr << "Invalid signature at input " << first + i << ": " << inputs[i] << std::endl;
+                out << '!' << inputs[i] << '\n';
+                continue;
+            }
+            if (seen) {
+                if (seen->count(results[i]) > 0) {
+                    continue;
+                }
+                seen->insert(results[i]);
+            }
+            out << results[i] << '\n';
+        }
+    }
+
+public:
+    //Streams isoSigs from in and writes their canonical signatures to out in input order.
+    //At most three chunks are held at once: the chunk being read, the chunk being
+    //canonicalised and the previous chunk, with its results, waiting to be written.
+    //With dedup, every distinct output is remembered, so memory grows with the
+    //number of distinct signatures rather than with the size of the input.
+    template <int dim>
+    static size_t canonicaliseStream(std::istream& in, std::ostream& out, bool dedup) {
+        return canonicaliseStream<dim>(in, out, dedup, [](Triangulation<dim>* triangulation) {
+            return IsoSig::computeSignature(triangulation);
+        });
+    }
+
+    //As above, with canonicalise used in place of IsoSig::computeSignature.
+    //It is called from several threads at once.
+    template <int dim, class F>
+    static size_t canonicaliseStream(std::istream& in, std::ostream& out, bool dedup, const F& canonicalise) {
+        std::vector<std::string> current, next, writtenInputs;
+        std::vector<std::string> results(chunkSize), written(chunkSize);
+        std::unordered_set<std::string> seen;
+        std::unordered_set<std::string>* seenPtr = dedup ? &seen : nullptr;
+        current.reserve(chunkSize);
+        next.reserve(chunkSize);
+        writtenInputs.reserve(chunkSize);
+        size_t total = 0;
+        int pending = 0; //Results of the previous chunk still to be written
+        bool more = readChunk(in, current);
+        while (more) {
+            int count = current.size();
+            #pragma omp parallel
+            {
+                //One thread handles IO for the neighbouring chunks while the rest canonicalise
+                #pragma omp single nowait
+                {
+                    writeChunk(out, writtenInputs, written, pending, total - pending + 1, seenPtr);
+                    more = readChunk(in, next);
+                }
+                #pragma omp for schedule(dynamic, 64)
+                for (int i = 0; i < count; i++) {
+                    Triangulation<dim>* triangulation = Triangulation<dim>::fromIsoSig(current[i]);
+                    if (triangulation) {
+                        results[i] = canonicalise(triangulation);
+                        delete triangulation;
+                    } else {
+                        results[i].clear();
+                    }
+                }
+            }
+            total += count;
+            pending = count;
+            std::swap(results, written);
+            //The inputs just canonicalised are kept for writing; next is refilled from the oldest
+            std::swap(current, writtenInputs);
+            std::swap(current, next);
+        }
+        writeChunk(out, writtenInputs, written, pending, total - pending + 1, seenPtr);
+        out.flush();
+        return total;
+    }
+};
+#endif
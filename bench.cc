@@ -0,0 +1,290 @@
+#include <vector>
+#include <unordered_set>
+#include <iostream>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <fstream>
+#include <cstdint>
+
+#include "isosig.h"
+#include "search.h"
+#include "searchParallel.h"
+#include "information.h"
+
+#include<triangulation/dim3.h>
+#include<triangulation/dim4.h>
+#include<triangulation/example3.h>
+#include<triangulation/example4.h>
+#include<triangulation/detail/triangulation.h>
+
+/* Benchmark suite. Datasets are generated from a fixed seed, and are binned
+ * and deduplicated only through Regina (isoSig and automorphism counts), so
+ * every build measures the same triangulations. Each result is printed as
+ * one JSON line:
+ *   {"bench":..., "dim":..., "size":..., "symmetry":..., "items":..., "ns_per_op":...}
+ * ns_per_op is the median over repeats, so two builds can be compared by
+ * diffing (or joining on bench/dim/size/symmetry) their outputs. The Regina
+ * isoSigs of every bin are written to bench.dataset.<dim>.txt and summarised
+ * by the checksum of each "dataset" line, so two runs can first be checked
+ * to have measured the same triangulations.
+*/
+
+//Fixed parameters; change only together with a note in the results being compared
+static const unsigned seed = 2020;
+static const int repeats = 5;
+static const int perBin = 50;
+//Visits to a bin's size that add nothing to it before the bin is given up on
+static const int maxMisses = 100 * perBin;
+
+//Symmetry class from the number of automorphisms, as Regina counts them, so
+//that it does not depend on the code being benchmarked
+template <int dim>
+std::string symmetryClass(Triangulation<dim>* triangulation) {
+    std::vector<Isomorphism<dim>*> automorphisms;
+    triangulation->findAllIsomorphisms(*triangulation, std::back_inserter(automorphisms));
+    size_t count = automorphisms.size();
+    for (auto automorphism : automorphisms) {
+        delete automorphism;
+    }
+    if (count <= 1) {
+        return "low";
+    } else if (count <= 3) {
+        return "mid";
+    }
+    return "high";
+}
+
+template <int dim>
+struct Bin {
+    size_t size;
+    std::string symmetry;
+    std::vector<Triangulation<dim>*> triangulations;
+    int misses;
+
+    //Whether the walk no longer looks for triangulations for this bin
+    bool done() const {
+        return triangulations.size() >= perBin || misses >= maxMisses;
+    }
+};
+
+//Median wall time of op over repeats, divided by the number of items it processes
+static double measure(const std::function<void()>& op, size_t items) {
+    std::vector<double> times;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        op();
+        auto stop = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[repeats / 2] / std::max<size_t>(items, 1);
+}
+
+static void output(const std::string& bench, int dim, size_t size, const std::string& symmetry,
+        size_t items, double nsPerOp) {
+    std::cout << "{\"bench\":\"" << bench << "\",\"dim\":" << dim << ",\"size\":" << size
+        << ",\"symmetry\":\"" << symmetry << "\",\"items\":" << items
+        << ",\"ns_per_op\":" << (long long)nsPerOp << "}" << std::endl;
+}
+
+//Random Pachner walks from the standard sphere, recording triangulations of
+//each requested size until every (size, symmetry) bin holds perBin of them or
+//has been given up on after maxMisses; bins left short are reported on stderr
+template <int dim>
+std::vector<Bin<dim>> generate(const std::vector<size_t>& sizes) {
+    std::mt19937 rng(seed + dim);
+    std::vector<Bin<dim>> bins;
+    std::unordered_set<std::string> seen;
+    size_t maxSize = *std::max_element(sizes.begin(), sizes.end());
+    for (size_t size : sizes) {
+        for (auto symmetry : {"low", "mid", "high"}) {
+            bins.push_back(Bin<dim>{size, symmetry, {}, 0});
+        }
+    }
+    Triangulation<dim>* current = Example<dim>::sphere();
+    auto allDone = [&]() {
+        return std::all_of(bins.begin(), bins.end(), [](const Bin<dim>& b) { return b.done(); });
+    };
+    //Also bounded in case a requested size is never reached
+    for (int step = 0; step < 200 * perBin * (int)bins.size() && ! allDone(); step++) {
+        std::vector<Triangulation<dim>*> adj = Search::getPachnerMoves(current, maxSize + dim);
+        if (adj.empty()) {
+            break;
+        }
+        size_t choice = rng() % adj.size();
+        for (size_t i = 0; i < adj.size(); i++) {
+            if (i != choice) {
+                delete adj[i];
+            }
+        }
+        delete current;
+        current = adj[choice];
+        //The automorphism count is only worth computing when a bin of this size is open
+        if (std::none_of(bins.begin(), bins.end(), [&](const Bin<dim>& b) {
+                return b.size == current->size() && ! b.done();
+            })) {
+            continue;
+        }
+        std::string symmetry = symmetryClass(current);
+        auto bin = std::find_if(bins.begin(), bins.end(), [&](const Bin<dim>& b) {
+            return b.size == current->size() && b.symmetry == symmetry;
+        });
+        bool added = false;
+        if (bin != bins.end() && ! bin->done()) {
+            std::string sig = current->isoSig();
+            if (seen.count(sig) == 0) {
+                seen.insert(sig);
+                bin->triangulations.push_back(new Triangulation<dim>(*current, false));
+                added = true;
+            }
+        }
+        for (auto& b : bins) {
+            if (b.size == current->size() && ! b.done() && ! (added && &b == &*bin)) {
+                b.misses++;
+            }
+        }
+    }
+    delete current;
+    for (auto& bin : bins) {
+        if (bin.triangulations.size() < perBin) {
+            std::cerr << "Bin dim:" << dim << " size:" << bin.size << " symmetry:" << bin.symmetry
+                << " has " << bin.triangulations.size() << " of " << perBin << " triangulations" << std::endl;
+        }
+    }
+    bins.erase(std::remove_if(bins.begin(), bins.end(), [](const Bin<dim>& b) {
+        return b.triangulations.empty();
+    }), bins.end());
+    return bins;
+}
+
+template <int dim>
+void microbenchmarks(std::vector<Bin<dim>>& bins) {
+    for (auto& bin : bins) {
+        auto& tris = bin.triangulations;
+        std::vector<GluingTable<dim>> gluings;
+        for (auto tri : tris) {
+            gluings.emplace_back(tri);
+        }
+        //Guards against the optimiser discarding results
+        size_t sink = 0;
+
+        output("isoSigFrom", dim, bin.size, bin.symmetry, tris.size(), measure([&]() {
+            for (auto& g : gluings) {
+                sink += IsoSig::isoSigFrom(g, 0, 0, (Isomorphism<dim>*) nullptr).size();
+            }
+        }, tris.size()));
+
+        output("SimplexInfo", dim, bin.size, bin.symmetry, tris.size(), measure([&]() {
+            for (auto tri : tris) {
+                for (size_t i = 0; i < tri->size(); i++) {
+                    SimplexInfo<dim> info(tri->simplex(i), i, tri->size());
+                    sink += info.getLabel();
+                }
+            }
+        }, tris.size()));
+
+        output("computeSignature", dim, bin.size, bin.symmetry, tris.size(), measure([&]() {
+            for (auto tri : tris) {
+                sink += IsoSig::computeSignature(tri).size();
+            }
+        }, tris.size()));
+
+        output("reginaIsoSig", dim, bin.size, bin.symmetry, tris.size(), measure([&]() {
+            for (auto tri : tris) {
+                sink += tri->isoSig().size();
+            }
+        }, tris.size()));
+
+        output("getPachnerMoves", dim, bin.size, bin.symmetry, tris.size(), measure([&]() {
+            for (auto tri : tris) {
+                std::vector<Triangulation<dim>*> adj = Search::getPachnerMoves(tri, bin.size + dim);
+                sink += adj.size();
+                for (auto alt : adj) {
+                    delete alt;
+                }
+            }
+        }, tris.size()));
+
+        std::vector<std::string> sigs;
+        for (auto tri : tris) {
+            sigs.push_back(IsoSig::computeSignature(tri));
+        }
+        output("visitedSet", dim, bin.size, bin.symmetry, sigs.size(), measure([&]() {
+            std::unordered_set<std::string> visited;
+            for (auto& sig : sigs) {
+                if (visited.count(sig) == 0) {
+                    visited.insert(sig);
+                }
+            }
+            sink += visited.size();
+        }, sigs.size()));
+
+        if (sink == 0) {
+            std::cerr << "Empty benchmark results" << std::endl;
+        }
+    }
+}
+
+//Complete search from the standard sphere up to tLimit simplices through the
+//production entry point, so the frontier, memory governor and any PIPELINE or
+//NUMA_SHARDS build flags are measured. Its per-node output is discarded.
+template <int dim>
+void searchBenchmark(int tLimit) {
+    size_t found = 0;
+    std::ofstream discard("/dev/null");
+    double ns = measure([&]() {
+        Triangulation<dim>* start = Example<dim>::sphere();
+        std::vector<std::string> names = {start->isoSig()};
+        delete start;
+        std::streambuf* out = std::cout.rdbuf(discard.rdbuf());
+        found = SearchParallel::searchExhaustiveParallel<dim>(names, tLimit);
+        std::cout.rdbuf(out);
+    }, 1);
+    output("search", dim, tLimit, "all", found, ns / std::max<size_t>(found, 1));
+}
+
+//Writes the isoSigs of every bin to bench.dataset.<dim>.txt and prints a
+//"dataset" line per bin with an FNV-1a checksum of its isoSigs
+template <int dim>
+void recordDataset(const std::vector<Bin<dim>>& bins) {
+    std::ofstream out("bench.dataset." + std::to_string(dim) + ".txt");
+    for (auto& bin : bins) {
+        uint64_t checksum = 14695981039346656037ULL;
+        for (auto tri : bin.triangulations) {
+            std::string sig = tri->isoSig();
+            out << bin.size << " " << bin.symmetry << " " << sig << std::endl;
+            for (char c : sig + "\n") {
+                checksum = (checksum ^ (unsigned char)c) * 1099511628211ULL;
+            }
+        }
+        std::cout << "{\"bench\":\"dataset\",\"dim\":" << dim << ",\"size\":" << bin.size
+            << ",\"symmetry\":\"" << bin.symmetry << "\",\"items\":" << bin.triangulations.size()
+            << ",\"checksum\":\"" << std::hex << checksum << std::dec << "\"}" << std::endl;
+    }
+}
+
+template <int dim>
+void run(const std::vector<size_t>& sizes, int tLimit) {
+    std::vector<Bin<dim>> bins = generate<dim>(sizes);
+    recordDataset<dim>(bins);
+    microbenchmarks<dim>(bins);
+    searchBenchmark<dim>(tLimit);
+    for (auto& bin : bins) {
+        for (auto tri : bin.triangulations) {
+            delete tri;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    //Initialised once here, so the search benchmark can run the MPI search repeatedly
+    MPI_Init(&argc, &argv);
+    run<3>({4, 8, 16, 32, 64}, 6);
+    run<4>({6, 10, 14, 20}, 6);
+    MPI_Finalize();
+    return 0;
+}
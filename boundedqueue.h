@@ -0,0 +1,99 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+/* Fixed capacity lock-free multi-producer multi-consumer queue (Vyukov's bounded
+ * queue). Each cell carries a sequence number telling producers and consumers
+ * whose turn it is, so push and pop each need a single compare-and-swap on the
+ * shared position. A full queue makes tryPush fail, which callers use as
+ * backpressure.
+*/
+template <class T>
+class BoundedQueue {
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<Cell[]> buffer;
+        size_t mask;
+        alignas(64) std::atomic<size_t> enqueuePos;
+        alignas(64) std::atomic<size_t> dequeuePos;
+
+    public:
+        //Capacity is rounded up to a power of two
+        BoundedQueue(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            buffer.reset(new Cell[size]);
+            mask = size - 1;
+            for (size_t i = 0; i < size; i++) {
+                buffer[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        bool tryPush(const T& data) {
+            size_t pos = enqueuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = buffer[pos & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+                if (diff == 0) {
+                    if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.data = data;
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) { //Full
+                    return false;
+                } else {
+                    pos = enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool tryPop(T& data) {
+            size_t pos = dequeuePos.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = buffer[pos & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+                if (diff == 0) {
+                    if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        data = cell.data;
+                        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) { //Empty
+                    return false;
+                } else {
+                    pos = dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        //Approximate while other threads are pushing or popping
+        size_t size() const {
+            size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+            size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+            return enqueued > dequeued ? enqueued - dequeued : 0;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        size_t capacity() const {
+            return mask + 1;
+        }
+};
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef CENSUS_H
+#define CENSUS_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "varint.h"
+#include "sigheader.h"
+#include "sighash.h"
+
+#include<triangulation/detail/isosig-impl.h>
+
+using namespace regina;
+using namespace detail;
+
+/* Sorted, memory-mapped index of canonical signatures, one file per rank
+ * (census.<rank>.idx, written by a -DCENSUS_INDEX search). Layout:
+ *  - Header;
+ *  - blocks of up to blockSize signatures in sorted order, front-coded: each entry
+ *    is varint(length shared with the previous entry), varint(suffix length), suffix,
+ *    and the first entry of a block shares nothing;
+ *  - padding to 8 bytes, then the file offset of every block as a uint64.
+ * Opening only maps the file, so startup does not depend on the census size. Lookups
+ * binary search the block offsets, comparing against the first entry of each block
+ * in place, then compare against the front-coded entries of one block in place.
+ * Integers are stored in native byte order. A signature is in the shard SigHash
+ * assigns it, and the header records which hash that was.
+*/
+class CensusIndex {
+private:
+    static const uint32_t version = 2;
+    static const uint32_t blockSize = 64;
+    //Entries written between flushes of the output buffer
+    static const size_t flushSize = 1 << 20;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t blockSize;
+        //Rank that wrote the file and the number of ranks, which picks the file owning a signature
+        uint32_t shard;
+        uint32_t nShards;
+        //SigHash::id of the hash assigning signatures to shards
+        uint32_t hash;
+        uint32_t reserved;
+        uint64_t count;
+        uint64_t nBlocks;
+        uint64_t indexOffset;
+    };
+
+    const char* data;
+    size_t length;
+    Header header;
+    const uint64_t* blocks;
+
+    CensusIndex(const char* data, size_t length, const Header& header) :
+        data(data), length(length), header(header),
+        blocks(reinterpret_cast<const uint64_t*>(data + header.indexOffset)) {}
+
+    static const char* magic() {
+        return "TRICENSI";
+    }
+
+    //First entry of a block, read in place
+    std::string_view first(size_t block) const {
+        const char* p = data + blocks[block];
+        Varint::get(p);
+        size_t size = Varint::get(p);
+        return std::string_view(p, size);
+    }
+
+    //Number of entries less than key, and whether key itself is present
+    size_t lowerBound(const std::string& key, bool& found) const {
+        found = false;
+        //First block starting after key
+        size_t lo = 0;
+        size_t hi = header.nBlocks;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (first(mid).compare(key) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == 0) {
+            return 0;
+        }
+        size_t block = lo - 1;
+        size_t rank = block * header.blockSize;
+        size_t entries = std::min<uint64_t>(header.blockSize, header.count - rank);
+        const char* p = data + blocks[block];
+        //Length of the prefix the previous entry, which is less than key, shares with key
+        size_t matched = 0;
+        for (size_t i = 0; i < entries; i++, rank++) {
+            size_t shared = Varint::get(p);
+            size_t size = Varint::get(p);
+            const char* suffix = p;
+            p += size;
+            //Sorted entries differ from the previous one at position shared, so one sharing
+            //more with it than key does is less than key, and one sharing less is greater
+            if (shared > matched) {
+                continue;
+            }
+            if (shared < matched) {
+                return rank;
+            }
+            size_t n = 0;
+            size_t limit = std::min(size, key.size() - matched);
+            while (n < limit && suffix[n] == key[matched + n]) {
+                n++;
+            }
+            matched += n;
+            if (n == size) {
+                if (matched == key.size()) {
+                    found = true;
+                    return rank;
+                }
+                //A proper prefix of key
+                continue;
+            }
+            if (matched == key.size() || (unsigned char)suffix[n] > (unsigned char)key[matched]) {
+                return rank;
+            }
+        }
+        return rank;
+    }
+
+    size_t lowerBound(const std::string& key) const {
+        bool found;
+        return lowerBound(key, found);
+    }
+
+public:
+    ~CensusIndex() {
+        munmap((void*)data, length);
+    }
+
+    CensusIndex(const CensusIndex&) = delete;
+    CensusIndex& operator=(const CensusIndex&) = delete;
+
+    static std::string path(const std::string& base, int shard) {
+        return base + "." + std::to_string(shard) + ".idx";
+    }
+
+    //Sorts sigs and writes them to path, returning whether the write succeeded
+    static bool write(const std::string& path, std::vector<std::string>& sigs, int shard, int nShards) {
+        std::sort(sigs.begin(), sigs.end());
+        sigs.erase(std::unique(sigs.begin(), sigs.end()), sigs.end());
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        Header header = {};
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.version = version;
+        header.blockSize = blockSize;
+        header.shard = shard;
+        header.nShards = nShards;
+        header.hash = SigHash::id;
+        header.count = sigs.size();
+        out.write((const char*)&header, sizeof(header));
+
+        std::vector<uint64_t> offsets;
+        uint64_t offset = sizeof(header);
+        std::string buffer;
+        for (size_t i = 0; i < sigs.size(); i++) {
+            size_t shared = 0;
+            if (i % blockSize == 0) {
+                offsets.push_back(offset + buffer.size());
+            } else {
+                size_t limit = std::min(sigs[i].size(), sigs[i - 1].size());
+                while (shared < limit && sigs[i][shared] == sigs[i - 1][shared]) {
+                    shared++;
+                }
+            }
+            Varint::put(buffer, shared);
+            Varint::put(buffer, sigs[i].size() - shared);
+            buffer.append(sigs[i], shared, std::string::npos);
+            if (buffer.size() >= flushSize) {
+                out.write(buffer.data(), buffer.size());
+                offset += buffer.size();
+                buffer.clear();
+            }
+        }
+        buffer.append((8 - (offset + buffer.size()) % 8) % 8, '\0');
+        out.write(buffer.data(), buffer.size());
+        offset += buffer.size();
+
+        header.nBlocks = offsets.size();
+        header.indexOffset = offset;
+        out.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+        out.seekp(0);
+        out.write((const char*)&header, sizeof(header));
+        return out.good();
+    }
+
+    //Maps an index written by write, or returns nullptr if it is missing or malformed
+    static CensusIndex* open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+            close(fd);
+            return nullptr;
+        }
+        size_t length = st.st_size;
+        void* map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            return nullptr;
+        }
+        Header header;
+        std::memcpy(&header, map, sizeof(header));
+        if (std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 || header.version != version
+                || header.hash != SigHash::id || header.indexOffset % 8 != 0 || header.indexOffset + header.nBlocks * sizeof(uint64_t) > length) {
+            munmap(map, length);
+            return nullptr;
+        }
+        //Lookups touch a few scattered pages each, so readahead only wastes memory
+        madvise(map, length, MADV_RANDOM);
+        return new CensusIndex((const char*)map, length, header);
+    }
+
+    //Opens base.0.idx and the other shards its header names; empty if any is missing
+    static std::vector<CensusIndex*> openAll(const std::string& base) {
+        std::vector<CensusIndex*> shards;
+        CensusIndex* zero = open(path(base, 0));
+        if (! zero) {
+            return shards;
+        }
+        shards.push_back(zero);
+        for (uint32_t i = 1; i < zero->shards(); i++) {
+            CensusIndex* shard = open(path(base, i));
+            if (! shard || shard->shards() != zero->shards()) {
+                delete shard;
+                for (auto opened : shards) {
+                    delete opened;
+                }
+                return std::vector<CensusIndex*>();
+            }
+            shards.push_back(shard);
+        }
+        return shards;
+    }
+
+    //Shard owning a signature, chosen by hash as the search assigns signatures to ranks
+    static CensusIndex* shardFor(const std::vector<CensusIndex*>& shards, const std::string& sig) {
+        return shards[SigHash::owner(sig, shards.size())];
+    }
+
+    //Signature header encoding the number of simplices, shared by all connected
+    //triangulations of that size
+    static std::string sizePrefix(size_t n) {
+        std::string ans;
+        SigHeader::append(ans, n);
+        return ans;
+    }
+
+    bool contains(const std::string& sig) const {
+        bool found;
+        lowerBound(sig, found);
+        return found;
+    }
+
+    //Number of entries starting with prefix
+    size_t countPrefix(const std::string& prefix) const {
+        //Smallest string greater than every string starting with prefix
+        std::string next = prefix;
+        while (! next.empty() && (unsigned char)next.back() == 0xff) {
+            next.pop_back();
+        }
+        if (next.empty()) {
+            return header.count - lowerBound(prefix);
+        }
+        next.back()++;
+        return lowerBound(next) - lowerBound(prefix);
+    }
+
+    //Number of connected triangulations with n simplices
+    size_t countSize(size_t n) const {
+        return countPrefix(sizePrefix(n));
+    }
+
+    size_t size() const {
+        return header.count;
+    }
+
+    uint32_t shard() const {
+        return header.shard;
+    }
+
+    uint32_t shards() const {
+        return header.nShards;
+    }
+};
+#endif
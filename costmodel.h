@@ -0,0 +1,120 @@
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+
+#include "isosig.h"
+#include "search.h"
+
+#include<triangulation/dim3.h>
+#include<triangulation/dim4.h>
+#include<triangulation/example3.h>
+#include<triangulation/example4.h>
+#include<triangulation/detail/triangulation.h>
+
+using namespace regina;
+
+/* Chooses per triangulation between IsoSig::computeSignature and Regina's isoSig().
+ * The candidate count comes from the SimplexInfo partition (IsoSig::getCandidates)
+ * and is weighed against Regina's n * (dim+1)! starting points, using per-walk
+ * costs measured at startup.
+ *
+ * Both must give the same canonical form, so Regina is only used when the candidate
+ * set is every simplex with every permutation of a connected triangulation. Both
+ * then take the smallest isoSigFrom over the same starting points, which is exactly
+ * Regina's isoSig. In every other case computeSignature is used.
+*/
+class CostModel {
+private:
+    static const unsigned seed = 7;
+    static const int sampleSize = 32;
+    static const int sampleSimplices = 16;
+
+    //Nanoseconds per walked simplex of one candidate, for each canonicaliser
+    double customNs;
+    double reginaNs;
+
+    CostModel(double customNs, double reginaNs) : customNs(customNs), reginaNs(reginaNs) {}
+
+    //Triangulations reached by a fixed random walk of Pachner moves from the standard sphere
+    template <int dim>
+    static std::vector<Triangulation<dim>*> sample() {
+        std::mt19937 rng(seed);
+        std::vector<Triangulation<dim>*> ans;
+        Triangulation<dim>* current = Example<dim>::sphere();
+        while ((int)ans.size() < sampleSize) {
+            std::vector<Triangulation<dim>*> adj = Search::getPachnerMoves(current, sampleSimplices);
+            if (adj.empty()) {
+                break;
+            }
+            size_t choice = rng() % adj.size();
+            for (size_t i = 0; i < adj.size(); i++) {
+                if (i != choice) {
+                    delete adj[i];
+                }
+            }
+            delete current;
+            current = adj[choice];
+            ans.push_back(new Triangulation<dim>(*current, false));
+        }
+        delete current;
+        return ans;
+    }
+
+public:
+    //Times both canonicalisers on a short fixed sample
+    template <int dim>
+    static CostModel calibrate() {
+        std::vector<Triangulation<dim>*> triangulations = sample<dim>();
+        double customWork = 0;
+        double reginaWork = 0;
+        double customTime = 0;
+        double reginaTime = 0;
+        for (auto tri : triangulations) {
+            auto candidates = IsoSig::getCandidates(tri);
+            auto start = std::chrono::steady_clock::now();
+            std::string ours = IsoSig::computeSignature(tri, candidates);
+            auto stop = std::chrono::steady_clock::now();
+            std::string theirs = tri->isoSig();
+            auto stop2 = std::chrono::steady_clock::now();
+            customTime += std::chrono::duration<double, std::nano>(stop - start).count();
+            reginaTime += std::chrono::duration<double, std::nano>(stop2 - stop).count();
+            customWork += (double)candidates.size() * tri->size();
+            reginaWork += (double)Perm<dim + 1>::nPerms * tri->size() * tri->size();
+            delete tri;
+        }
+        return CostModel(customTime / std::max(customWork, 1.0), reginaTime / std::max(reginaWork, 1.0));
+    }
+
+    //Whether Regina's isoSig gives our canonical form and is expected to be cheaper
+    template <int dim>
+    bool preferRegina(Triangulation<dim>* triangulation, const std::vector<std::pair<size_t, int>>& candidates) const {
+        double n = triangulation->size();
+        double all = n * Perm<dim + 1>::nPerms;
+        if (candidates.size() != all || ! triangulation->isConnected()) {
+            return false;
+        }
+        //Both walk the same starting points, so only the cost per walk differs
+        return reginaNs < customNs;
+    }
+
+    template <int dim>
+    std::string computeSignature(Triangulation<dim>* triangulation) const {
+        std::vector<std::pair<size_t, int>> candidates = IsoSig::getCandidates(triangulation);
+        if (preferRegina(triangulation, candidates)) {
+            return triangulation->isoSig();
+        }
+        return IsoSig::computeSignature(triangulation, candidates);
+    }
+
+    double customCost() const {
+        return customNs;
+    }
+
+    double reginaCost() const {
+        return reginaNs;
+    }
+};
+#endif
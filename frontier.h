@@ -0,0 +1,284 @@
+#ifndef FRONTIER_H
+#define FRONTIER_H
+#include <string>
+#include <deque>
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+
+#include <unistd.h>
+
+#include "memory.h"
+#include "varint.h"
+
+/* Queue of signatures waiting to be expanded, with the interface of the
+ * std::queue<std::string> it replaces. Entries are stored according to the
+ * MemoryGovernor level when they are pushed:
+ *  - below Compress as strings;
+ *  - at Compress as records in 64KB blocks: a varint character count followed by
+ *    the characters packed at 6 bits each (signatures use a 64 character alphabet);
+ *  - at Spill as the same records appended to frontier.<host>.<pid>.<n>.spill,
+ *    named by host as well as pid since ranks on different nodes may share a directory.
+ * Entering a level moves the entries already held in memory down to it. Pops take
+ * strings, then packed records, then reload a chunk from disk, so entries do not
+ * leave in the order they were pushed; the search does not depend on that order.
+ * Like std::queue it is not thread safe.
+*/
+class Frontier {
+private:
+    static const size_t blockBytes = 1 << 16;
+    //Spilled entries read back into memory at once
+    static const size_t reloadEntries = 1 << 16;
+
+    std::deque<std::string> plain;
+    std::deque<std::string> blocks;
+    //Read position in the first block
+    size_t blockOffset;
+    size_t packedCount;
+
+    std::string spillPath;
+    std::ofstream spillOut;
+    std::ifstream spillIn;
+    size_t spilledCount;
+
+    //Entry returned by front, already taken from storage
+    std::string head;
+    bool loaded;
+    size_t count;
+    MemoryGovernor::Level mode;
+
+    static int value(char c) {
+        if (c >= 'a' && c <= 'z') return c - 'a';
+        if (c >= 'A' && c <= 'Z') return c - 'A' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '-') return 63;
+        return -1;
+    }
+
+    static char character(int value) {
+        static const char* alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+-";
+        return alphabet[value];
+    }
+
+    static bool packable(const std::string& s) {
+        for (char c : s) {
+            if (value(c) < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void pack(std::string& out, const std::string& s) {
+        Varint::put(out, s.size());
+        unsigned bits = 0;
+        int nBits = 0;
+        for (char c : s) {
+            bits = (bits << 6) | value(c);
+            nBits += 6;
+            if (nBits >= 8) {
+                nBits -= 8;
+                out += (char)(bits >> nBits);
+            }
+        }
+        if (nBits > 0) {
+            out += (char)(bits << (8 - nBits));
+        }
+    }
+
+    //Decodes the record at data, returning its length in bytes
+    static size_t unpack(const char* data, std::string& s) {
+        const char* p = data;
+        size_t n = Varint::get(p);
+        s.clear();
+        unsigned bits = 0;
+        int nBits = 0;
+        while (s.size() < n) {
+            if (nBits < 6) {
+                bits = (bits << 8) | (unsigned char)*p++;
+                nBits += 8;
+            }
+            nBits -= 6;
+            s += character((bits >> nBits) & 0x3f);
+        }
+        return p - data;
+    }
+
+    void pushPacked(const std::string& record) {
+        if (blocks.empty() || blocks.back().size() + record.size() > blockBytes) {
+            blocks.emplace_back();
+            blocks.back().reserve(record.size() > blockBytes ? record.size() : blockBytes);
+            MemoryGovernor::add(MemoryGovernor::Queue, blocks.back().capacity());
+        }
+        blocks.back() += record;
+        packedCount++;
+    }
+
+    void pushSpilled(const std::string& record) {
+        if (! spillOut.is_open()) {
+            spillOut.open(spillPath, std::ios::binary | std::ios::trunc);
+        }
+        spillOut.write(record.data(), record.size());
+        spilledCount++;
+    }
+
+    void pushPlain(const std::string& s) {
+        plain.push_back(s);
+        MemoryGovernor::add(MemoryGovernor::Queue, MemoryGovernor::stringBytes(plain.back()));
+    }
+
+    //Moves the entries held in memory down to the current level
+    void demote(MemoryGovernor::Level level) {
+        std::string record;
+        std::deque<std::string> kept;
+        for (auto& s : plain) {
+            if (! packable(s)) {
+                kept.push_back(std::move(s));
+                continue;
+            }
+            record.clear();
+            pack(record, s);
+            level >= MemoryGovernor::Spill ? pushSpilled(record) : pushPacked(record);
+            MemoryGovernor::add(MemoryGovernor::Queue, -(int64_t)MemoryGovernor::stringBytes(s));
+        }
+        plain.swap(kept);
+        if (level >= MemoryGovernor::Spill) {
+            std::string s;
+            while (packedCount > 0) {
+                takePacked(s);
+                record.clear();
+                pack(record, s);
+                pushSpilled(record);
+            }
+        }
+        mode = level;
+    }
+
+    void takePacked(std::string& s) {
+        blockOffset += unpack(blocks.front().data() + blockOffset, s);
+        packedCount--;
+        if (blockOffset == blocks.front().size()) {
+            MemoryGovernor::add(MemoryGovernor::Queue, -(int64_t)blocks.front().capacity());
+            blocks.pop_front();
+            blockOffset = 0;
+        }
+    }
+
+    //Reads spilled records back into packed blocks
+    void reload() {
+        spillOut.flush();
+        if (! spillIn.is_open()) {
+            spillIn.open(spillPath, std::ios::binary);
+        }
+        spillIn.clear();
+        std::string record;
+        for (size_t i = 0; i < reloadEntries && spilledCount > 0; i++) {
+            record.clear();
+            size_t n = Varint::get(spillIn);
+            Varint::put(record, n);
+            size_t start = record.size();
+            record.resize(start + (n * 6 + 7) / 8);
+            spillIn.read(&record[start], record.size() - start);
+            pushPacked(record);
+            spilledCount--;
+        }
+        if (spilledCount == 0) {
+            //Everything on disk has been read, so start the next spill from an empty file
+            spillIn.close();
+            spillOut.close();
+            std::remove(spillPath.c_str());
+        }
+    }
+
+    //Takes the next entry from storage into head
+    void load() {
+        if (! plain.empty()) {
+            head = std::move(plain.front());
+            MemoryGovernor::add(MemoryGovernor::Queue, -(int64_t)MemoryGovernor::stringBytes(head));
+            plain.pop_front();
+        } else {
+            if (packedCount == 0 && spilledCount > 0) {
+                reload();
+            }
+            takePacked(head);
+        }
+        loaded = true;
+    }
+
+    static std::string hostname() {
+        char name[256] = {};
+        if (gethostname(name, sizeof(name) - 1) != 0) {
+            return "unknown";
+        }
+        return name;
+    }
+
+    static int nextId() {
+        static std::atomic<int> id(0);
+        return id++;
+    }
+
+public:
+    Frontier() : blockOffset(0), packedCount(0), spilledCount(0), loaded(false), count(0),
+        mode(MemoryGovernor::Full) {
+        spillPath = "frontier." + hostname() + "." + std::to_string(getpid()) + "." + std::to_string(nextId()) + ".spill";
+    }
+
+    ~Frontier() {
+        for (auto& block : blocks) {
+            MemoryGovernor::add(MemoryGovernor::Queue, -(int64_t)block.capacity());
+        }
+        for (auto& s : plain) {
+            MemoryGovernor::add(MemoryGovernor::Queue, -(int64_t)MemoryGovernor::stringBytes(s));
+        }
+        if (spillOut.is_open()) {
+            spillOut.close();
+            spillIn.close();
+            std::remove(spillPath.c_str());
+        }
+    }
+
+    Frontier(const Frontier&) = delete;
+    Frontier& operator=(const Frontier&) = delete;
+
+    void push(const std::string& s) {
+        MemoryGovernor::Level level = MemoryGovernor::level();
+        if (level != mode && level >= MemoryGovernor::Compress) {
+            demote(level);
+        }
+        count++;
+        if (level < MemoryGovernor::Compress || ! packable(s)) {
+            pushPlain(s);
+            return;
+        }
+        std::string record;
+        pack(record, s);
+        level >= MemoryGovernor::Spill ? pushSpilled(record) : pushPacked(record);
+    }
+
+    const std::string& front() {
+        if (! loaded) {
+            load();
+        }
+        return head;
+    }
+
+    void pop() {
+        if (! loaded) {
+            load();
+        }
+        loaded = false;
+        count--;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef GLUINGS_H
+#define GLUINGS_H
+
+#include <vector>
+#include <cstdint>
+
+#include<triangulation/dim3.h>
+#include<triangulation/dim4.h>
+#include<triangulation/detail/triangulation.h>
+
+using namespace regina;
+
+//Flat copy of a triangulation's gluings. Built once per triangulation so that
+//every candidate walk reads small integers rather than Regina's simplex objects
+//and each gluing's Perm index is computed only once.
+template <int dim>
+class GluingTable {
+    private:
+        size_t nSimp;
+        size_t nBoundary;
+    public:
+        //Indexed by simplex * (dim + 1) + facet; adjSimp is -1 on boundary facets
+        std::vector<ptrdiff_t> adjSimp;
+        std::vector<uint8_t> adjFacet;
+        std::vector<uint8_t> gluing;
+
+        GluingTable(Triangulation<dim>* triangulation) : nSimp(triangulation->size()), nBoundary(0),
+                adjSimp(nSimp * (dim + 1), -1), adjFacet(nSimp * (dim + 1), 0), gluing(nSimp * (dim + 1), 0) {
+            for (size_t i = 0; i < nSimp; i++) {
+                const Simplex<dim>* s = triangulation->simplex(i);
+                for (int facet = 0; facet <= dim; facet++) {
+                    size_t slot = i * (dim + 1) + facet;
+                    if (! s->adjacentSimplex(facet)) {
+                        nBoundary++;
+                        continue;
+                    }
+                    adjSimp[slot] = s->adjacentSimplex(facet)->index();
+                    adjFacet[slot] = s->adjacentFacet(facet);
+                    gluing[slot] = s->adjacentGluing(facet).index();
+                }
+            }
+        }
+
+        size_t size() const {
+            return nSimp;
+        }
+
+        //Number of distinct facets, counting each gluing once
+        size_t countFacets() const {
+            return ((dim + 1) * nSimp + nBoundary) / 2;
+        }
+};
+
+#endif
@@ -85,8 +85,8 @@ class SimplexInfo {
                     return compArr(simplexAnnotations[subdim], other.simplexAnnotations[subdim]);
                 }
             }
-            //Everything is equal 
-            return true; 
+            //Everything is equal, so not strictly less (std::sort needs a strict ordering)
+            return false;
         }     
 
         template <int subdim, int numbering = 0, int vertexCount = 0>
@@ -2,7 +2,14 @@
 #define ISO_SIG_H
 
 #include <vector>
+#include <memory>
+#include <atomic>
 #include "information.h"
+#include "permtables.h"
+#include "gluings.h"
+#include "lockstep.h"
+#include "stats.h"
+#include "sigheader.h"
 
 #include<triangulation/dim3.h>
 #include<triangulation/example3.h>
@@ -16,18 +23,35 @@ class IsoSig {
 private:
     IsoSig();
 public:
-    //This is a copy of the function from regina
+    //Triangulations at least this large canonicalise their candidates in parallel
+    static const size_t parallelThreshold = 63;
+
+    //This is a copy of the function from regina.
+    //If bound is given (a signature of the same connected triangulation), the walk
+    //stops as soon as its facet actions are lexicographically worse than bound's
+    //and the empty string is returned instead.
     template <int dim>
     static std::string isoSigFrom (Triangulation<dim>* triangulation, size_t simp, 
-            const Perm<dim+1>& vertices, Isomorphism<dim>* relabelling) {
-        size_t nSimp = triangulation->size();
-        size_t nFacets = ((dim + 1) * triangulation->size() + triangulation->countBoundaryFacets()) / 2;
+            const Perm<dim+1>& vertices, Isomorphism<dim>* relabelling,
+            const std::string* bound = nullptr) {
+        GluingTable<dim> gluings(triangulation);
+        return isoSigFrom(gluings, simp, vertices.index(), relabelling, bound);
+    }
+
+    //As above, but walks a prebuilt gluing table. All permutations are handled
+    //as indices through the compile time tables in permtables.h.
+    template <int dim>
+    static std::string isoSigFrom (const GluingTable<dim>& gluings, size_t simp,
+            int vertices, Isomorphism<dim>* relabelling,
+            const std::string* bound = nullptr) {
+        const PermTable<dim + 1>& table = permTable<dim + 1>;
+        size_t nSimp = gluings.size();
+        size_t nFacets = gluings.countFacets();
         char* facetAction = new char[nFacets];
         size_t* joinDest = new size_t[nFacets];
-        typedef typename Perm<dim+1>::Index PermIndex;
-        PermIndex* joinGluing = new PermIndex[nFacets];
+        uint8_t* joinGluing = new uint8_t[nFacets];
         ptrdiff_t* image = new ptrdiff_t[nSimp];
-        Perm<dim+1>* vertexMap = new Perm<dim+1>[nSimp];
+        uint8_t* vertexMap = new uint8_t[nSimp];
 
         // The preimage for each simplex:
         ptrdiff_t* preImage = new ptrdiff_t[nSimp];
@@ -38,7 +62,7 @@ public:
         size_t facetPos, joinPos, nextUnusedSimp;
         size_t simpImg, simpSrc, dest;
         unsigned facetImg, facetSrc;
-        const Simplex<dim>* s;
+        size_t slot;
 
         // ---------------------------------------------------------------------
         // The code!
@@ -48,24 +72,50 @@ public:
         std::fill(preImage, preImage + nSimp, -1);
 
         image[simp] = 0;
-        vertexMap[simp] = vertices.inverse();
+        vertexMap[simp] = table.inverse[vertices];
         preImage[0] = simp;
 
         facetPos = 0;
         joinPos = 0;
         nextUnusedSimp = 1;
 
+        // Facet actions are packed three to a character straight after the
+        // header, whose length depends only on the number of simplices.
+        bool comparing = (bound != nullptr);
+        bool pruned = false;
+        size_t comparedPos = 0;
+        size_t boundPos = SigHeader::length(nSimp);
+
         // To obtain a canonical isomorphism, we must run through the simplices
         // and their facets in image order, not preimage order.
         //
         // This main loop is guaranteed to exit when (and only when) we have
         // exhausted a single connected component of the triangulation.
-        for (simpImg = 0; simpImg < nSimp && preImage[simpImg] >= 0; ++simpImg) {
+        for (simpImg = 0; simpImg < nSimp && preImage[simpImg] >= 0 && ! pruned; ++simpImg) {
             simpSrc = preImage[simpImg];
-            s = triangulation->simplex(simpSrc);
 
             for (facetImg = 0; facetImg <= dim; ++facetImg) {
-                facetSrc = vertexMap[simpSrc].preImageOf(facetImg);
+                // Compare each completed character against the bound.
+                if (comparing && facetPos >= comparedPos + 3) {
+                    if (boundPos >= bound->size()) {
+                        comparing = false;
+                    } else {
+                        unsigned char ours = IsoSigHelper::SCHAR(facetAction[comparedPos] |
+                            facetAction[comparedPos + 1] << 2 | facetAction[comparedPos + 2] << 4);
+                        unsigned char theirs = (*bound)[boundPos];
+                        comparedPos += 3;
+                        ++boundPos;
+                        if (ours > theirs) {
+                            pruned = true;
+                            break;
+                        } else if (ours < theirs) {
+                            comparing = false;
+                        }
+                    }
+                }
+
+                facetSrc = table.preImage[vertexMap[simpSrc]][facetImg];
+                slot = simpSrc * (dim + 1) + facetSrc;
 
                 // INVARIANTS (held while we stay within a single component):
                 // - nextUnusedSimp > simpImg
@@ -73,7 +123,7 @@ public:
                 //   are already filled in.
 
                 // Work out what happens to our source facet.
-                if (! s->adjacentSimplex(facetSrc)) {
+                if (gluings.adjSimp[slot] < 0) {
                     // A boundary facet.
                     facetAction[facetPos++] = 0;
                     continue;
@@ -81,13 +131,13 @@ public:
 
                 // We have a real gluing.  Is it a gluing we've already seen
                 // from the other side?
-                dest = s->adjacentSimplex(facetSrc)->index();
+                dest = gluings.adjSimp[slot];
 
                 if (image[dest] >= 0)
                     if (image[dest] < image[simpSrc] ||
                             (dest == simpSrc &&
-                            vertexMap[simpSrc][s->adjacentFacet(facetSrc)]
-                            < vertexMap[simpSrc][facetSrc])) {
+                            table.image[vertexMap[simpSrc]][gluings.adjFacet[slot]]
+                            < table.image[vertexMap[simpSrc]][facetSrc])) {
                         // Yes.  Just skip this gluing entirely.
                         continue;
                     }
@@ -98,8 +148,8 @@ public:
                     // index, and the canonical gluing becomes the identity.
                     image[dest] = nextUnusedSimp++;
                     preImage[image[dest]] = dest;
-                    vertexMap[dest] = vertexMap[simpSrc] *
-                        s->adjacentGluing(facetSrc).inverse();
+                    vertexMap[dest] = table.compose[vertexMap[simpSrc]]
+                        [table.inverse[gluings.gluing[slot]]];
 
                     facetAction[facetPos++] = 1;
                     continue;
@@ -107,15 +157,24 @@ public:
 
                 // It's a simplex we've seen before.  Record the gluing.
                 joinDest[joinPos] = image[dest];
-                joinGluing[joinPos] = (vertexMap[dest] *
-                    s->adjacentGluing(facetSrc) * vertexMap[simpSrc].inverse()).
-                    index();
+                joinGluing[joinPos] = table.compose[table.compose[vertexMap[dest]]
+                    [gluings.gluing[slot]]][table.inverse[vertexMap[simpSrc]]];
                 ++joinPos;
 
                 facetAction[facetPos++] = 2;
             }
         }
 
+        if (pruned) {
+            delete[] image;
+            delete[] vertexMap;
+            delete[] preImage;
+            delete[] facetAction;
+            delete[] joinDest;
+            delete[] joinGluing;
+            return std::string();
+        }
+
         // We have all we need.  Pack it all together into a string.
         // We need to encode:
         // - the number of simplices in this component;
@@ -159,7 +218,7 @@ public:
         if (relabelling)
             for (i = 0; i < nCompSimp; ++i) {
                 relabelling->simpImage(i) = image[i];
-                relabelling->facetPerm(i) = vertexMap[i];
+                relabelling->facetPerm(i) = Perm<dim+1>::atIndex(vertexMap[i]);
             }
 
         // Done!
@@ -173,8 +232,83 @@ public:
         return ans;                
     }
 
+    //Tries the candidates across threads. The best signature so far is shared
+    //through an atomic pointer and used as a bound so losing walks stop early.
+    template <int dim>
+    static std::string computeSignatureParallel(Triangulation<dim>* triangulation,
+            const std::vector<std::pair<size_t, int>>& candidates) {
+        GluingTable<dim> gluings(triangulation);
+        std::shared_ptr<const std::string> best;
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < (int)candidates.size(); i++) {
+            std::shared_ptr<const std::string> bound = std::atomic_load(&best);
+            std::string curr = isoSigFrom(gluings, candidates[i].first,
+                candidates[i].second, (Isomorphism<dim>*) nullptr, bound.get());
+            if (curr.size() == 0) { //Pruned
+                continue;
+            }
+            auto currPtr = std::make_shared<const std::string>(std::move(curr));
+            while (! bound || *currPtr < *bound) {
+                if (std::atomic_compare_exchange_weak(&best, &bound, currPtr)) {
+                    break;
+                }
+            }
+        }
+        return best ? *best : std::string();
+    }
+
+    //Evaluates the candidates in batches of Lockstep<dim>::lanes, using the best
+    //signature of earlier batches as the bound for later ones
+    template <int dim>
+    static std::string computeSignatureLockstep(const GluingTable<dim>& gluings,
+            const std::vector<std::pair<size_t, int>>& candidates) {
+        Lockstep<dim> batch(gluings);
+        std::string ans;
+        for (size_t i = 0; i < candidates.size(); i += Lockstep<dim>::lanes) {
+            int count = std::min<size_t>(Lockstep<dim>::lanes, candidates.size() - i);
+            std::string curr = batch.best(&candidates[i], count, ans.size() > 0 ? &ans : nullptr);
+            if (curr.size() > 0 && (ans.size() == 0 || curr < ans)) {
+                ans = curr;
+            }
+        }
+        return ans;
+    }
+
     template <int dim>
     static std::string computeSignature(Triangulation<dim>* triangulation) {
+        return computeSignature(triangulation, getCandidates(triangulation));
+    }
+
+    //As above, with the candidates from getCandidates already computed
+    template <int dim>
+    static std::string computeSignature(Triangulation<dim>* triangulation,
+            const std::vector<std::pair<size_t, int>>& candidates) {
+        STATS_ADD(Stats::Signatures, 1);
+        STATS_ADD(Stats::Candidates, candidates.size());
+        if (triangulation->size() >= parallelThreshold && triangulation->isConnected()) {
+            return computeSignatureParallel(triangulation, candidates);
+        }
+        GluingTable<dim> gluings(triangulation);
+        if (candidates.size() >= Lockstep<dim>::lanes && triangulation->isConnected()) {
+            return computeSignatureLockstep(gluings, candidates);
+        }
+        std::string ans;
+        for (auto& candidate : candidates) {
+            std::string curr = isoSigFrom(gluings, candidate.first,
+                candidate.second, (Isomorphism<dim>*) nullptr);
+            if (ans.size() == 0) {
+                ans = curr;
+            } else {
+                ans = std::min(ans, curr);
+            }
+        }
+        return ans;
+    }
+
+    //Candidate starting points (simplex, permutation index) for computeSignature:
+    //every valid labelling of the simplices in the smallest SimplexInfo partition
+    template <int dim>
+    static std::vector<std::pair<size_t, int>> getCandidates(Triangulation<dim>* triangulation) {
         std::vector<SimplexInfo<dim>> properties;
         for (int i = 0; i < triangulation->size(); i++) {
             Simplex<dim>* tetrahedra = triangulation->simplex(i);
@@ -208,20 +342,15 @@ public:
                 partitionIndex = i;
             }
         }
-        std::string ans;
+        //Candidate starting points as (simplex, permutation index)
+        std::vector<std::pair<size_t, int>> candidates;
         for (int i = 0; i < partitionSizes[partitionIndex]; i++) {
             auto perms = properties[bestIndex + i].getAllPerms();
             for (auto perm : perms) {
-                std::string curr = isoSigFrom(triangulation, triangulation->simplex(properties[bestIndex + i].getLabel())->index(), 
-                    Perm<dim + 1>::atIndex(perm), (Isomorphism<dim>*) nullptr);
-                if (ans.size() == 0) {
-                    ans = curr;
-                } else {
-                    ans = std::min(ans, curr);
-                }
-            }    
+                candidates.emplace_back(triangulation->simplex(properties[bestIndex + i].getLabel())->index(), perm);
+            }
         }
-        return ans;
+        return candidates;
     }
 };
 #endif
\ No newline at end of file
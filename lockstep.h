@@ -0,0 +1,206 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include "permtables.h"
+#include "gluings.h"
+#include "sigheader.h"
+
+#include<triangulation/detail/isosig-impl.h>
+
+using namespace regina;
+using namespace detail;
+
+/* Evaluates a batch of isoSig candidates of one connected triangulation together.
+ * Every lane runs the same walk as IsoSig::isoSigFrom from its own starting point,
+ * with its state stored structure-of-arrays (index * lanes + lane). Lanes advance
+ * one packed facet-action character at a time; after each round the characters
+ * are compared across lanes and every lane worse than the smallest is dropped.
+ * Surviving lanes therefore share all facet actions, and only they are packed
+ * into full signatures at the end.
+*/
+template <int dim>
+class Lockstep {
+    public:
+        static const int lanes = 16;
+
+    private:
+        const GluingTable<dim>& gluings;
+        size_t nSimp;
+        size_t nFacets;
+        size_t headerLength;
+
+        std::vector<ptrdiff_t> image;
+        std::vector<ptrdiff_t> preImage;
+        std::vector<uint8_t> vertexMap;
+        std::vector<char> facetAction;
+        std::vector<size_t> joinDest;
+        std::vector<uint8_t> joinGluing;
+
+        size_t simpImg[lanes];
+        unsigned facetImg[lanes];
+        size_t facetPos[lanes];
+        size_t joinPos[lanes];
+        size_t nextUnusedSimp[lanes];
+        uint8_t symbol[lanes];
+        uint8_t active[lanes];
+
+        //Runs the walk for lane until it has emitted target facet actions or
+        //has exhausted the component
+        void advance(int lane, size_t target) {
+            const PermTable<dim + 1>& table = permTable<dim + 1>;
+            while (facetPos[lane] < target) {
+                if (facetImg[lane] > dim) {
+                    facetImg[lane] = 0;
+                    ++simpImg[lane];
+                }
+                if (simpImg[lane] >= nSimp || preImage[simpImg[lane] * lanes + lane] < 0) {
+                    return;
+                }
+                size_t simpSrc = preImage[simpImg[lane] * lanes + lane];
+                uint8_t map = vertexMap[simpSrc * lanes + lane];
+                unsigned facetSrc = table.preImage[map][facetImg[lane]];
+                size_t slot = simpSrc * (dim + 1) + facetSrc;
+                ++facetImg[lane];
+
+                if (gluings.adjSimp[slot] < 0) {
+                    facetAction[facetPos[lane]++ * lanes + lane] = 0;
+                    continue;
+                }
+                size_t dest = gluings.adjSimp[slot];
+                ptrdiff_t destImg = image[dest * lanes + lane];
+                if (destImg >= 0)
+                    if (destImg < image[simpSrc * lanes + lane] ||
+                            (dest == simpSrc &&
+                            table.image[map][gluings.adjFacet[slot]] < table.image[map][facetSrc])) {
+                        continue;
+                    }
+                if (destImg < 0) {
+                    image[dest * lanes + lane] = nextUnusedSimp[lane];
+                    preImage[nextUnusedSimp[lane] * lanes + lane] = dest;
+                    ++nextUnusedSimp[lane];
+                    vertexMap[dest * lanes + lane] = table.compose[map][table.inverse[gluings.gluing[slot]]];
+                    facetAction[facetPos[lane]++ * lanes + lane] = 1;
+                    continue;
+                }
+                joinDest[joinPos[lane] * lanes + lane] = destImg;
+                joinGluing[joinPos[lane] * lanes + lane] = table.compose[table.compose
+                    [vertexMap[dest * lanes + lane]][gluings.gluing[slot]]][table.inverse[map]];
+                ++joinPos[lane];
+                facetAction[facetPos[lane]++ * lanes + lane] = 2;
+            }
+        }
+
+        //Packs the signature of a lane once its walk is complete
+        std::string pack(int lane) {
+            std::string ans;
+            unsigned nChars = SigHeader::append(ans, nSimp);
+            char trits[3];
+            for (size_t i = 0; i < nFacets; i += 3) {
+                size_t count = (nFacets >= i + 3 ? 3 : nFacets - i);
+                for (size_t j = 0; j < count; j++) {
+                    trits[j] = facetAction[(i + j) * lanes + lane];
+                }
+                IsoSigHelper::SAPPENDTRITS(ans, trits, count);
+            }
+            for (size_t i = 0; i < joinPos[lane]; ++i)
+                IsoSigHelper::SAPPEND(ans, joinDest[i * lanes + lane], nChars);
+            for (size_t i = 0; i < joinPos[lane]; ++i)
+                IsoSigHelper::SAPPEND(ans, joinGluing[i * lanes + lane],
+                    IsoSigHelper::CHARS_PER_PERM<dim>());
+            return ans;
+        }
+
+    public:
+        //The gluing table must describe a connected triangulation and outlive this object
+        Lockstep(const GluingTable<dim>& gluings) : gluings(gluings), nSimp(gluings.size()),
+                nFacets(gluings.countFacets()), headerLength(SigHeader::length(nSimp)),
+                image(nSimp * lanes), preImage(nSimp * lanes), vertexMap(nSimp * lanes),
+                facetAction(nFacets * lanes), joinDest(nFacets * lanes), joinGluing(nFacets * lanes) {}
+
+        //Returns the smallest signature over up to lanes candidates (simplex, permutation
+        //index). If bound is given, returns the empty string when every candidate is
+        //worse than bound.
+        std::string best(const std::pair<size_t, int>* candidates, int count,
+                const std::string* bound = nullptr) {
+            const PermTable<dim + 1>& table = permTable<dim + 1>;
+            std::fill(image.begin(), image.end(), -1);
+            std::fill(preImage.begin(), preImage.end(), -1);
+            for (int lane = 0; lane < lanes; lane++) {
+                active[lane] = lane < count;
+                simpImg[lane] = 0;
+                facetImg[lane] = 0;
+                facetPos[lane] = 0;
+                joinPos[lane] = 0;
+                nextUnusedSimp[lane] = 1;
+                if (active[lane]) {
+                    size_t simp = candidates[lane].first;
+                    image[simp * lanes + lane] = 0;
+                    preImage[lane] = simp;
+                    vertexMap[simp * lanes + lane] = table.inverse[candidates[lane].second];
+                }
+            }
+            bool comparing = (bound != nullptr);
+            size_t boundPos = headerLength;
+            for (size_t pos = 0; pos < nFacets; pos += 3) {
+                size_t width = (nFacets >= pos + 3 ? 3 : nFacets - pos);
+                for (int lane = 0; lane < lanes; lane++) {
+                    if (active[lane]) {
+                        advance(lane, pos + width);
+                    }
+                }
+                //Facet actions of one position are contiguous across lanes
+                #pragma omp simd
+                for (int lane = 0; lane < lanes; lane++) {
+                    uint8_t trits = 0;
+                    for (size_t j = 0; j < width; j++) {
+                        trits |= facetAction[(pos + j) * lanes + lane] << (2 * j);
+                    }
+                    symbol[lane] = trits;
+                }
+                for (int lane = 0; lane < lanes; lane++) {
+                    symbol[lane] = active[lane] ? IsoSigHelper::SCHAR(symbol[lane]) : UINT8_MAX;
+                }
+                uint8_t least = UINT8_MAX;
+                #pragma omp simd reduction(min:least)
+                for (int lane = 0; lane < lanes; lane++) {
+                    least = std::min(least, symbol[lane]);
+                }
+                #pragma omp simd
+                for (int lane = 0; lane < lanes; lane++) {
+                    active[lane] &= (symbol[lane] == least);
+                }
+                if (comparing) {
+                    if (boundPos >= bound->size()) {
+                        comparing = false;
+                    } else {
+                        unsigned char theirs = (*bound)[boundPos++];
+                        if (least > theirs) {
+                            return std::string();
+                        } else if (least < theirs) {
+                            comparing = false;
+                        }
+                    }
+                }
+            }
+            //Survivors agree on every facet action (and hence on their joins' positions)
+            std::string ans;
+            for (int lane = 0; lane < lanes; lane++) {
+                if (! active[lane]) {
+                    continue;
+                }
+                std::string curr = pack(lane);
+                if (ans.size() == 0 || curr < ans) {
+                    ans = curr;
+                }
+            }
+            return ans;
+        }
+};
+
+#endif
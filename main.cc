@@ -12,6 +12,11 @@
 #include "search.h"
 #include "searchParallel.h"
 #include "information.h"
+#include "batch.h"
+#include "verify.h"
+#include "costmodel.h"
+#include "census.h"
+#include "service.h"
 
 #include<triangulation/dim3.h>
 #include<triangulation/dim4.h>
@@ -28,6 +33,12 @@
 // #define STAT
 // #define CORRECTNESS
 // #define TIMING
+// #define VERIFY 4 //Dimension of the input triangulations
+// #define BATCH
+// #define DEDUP
+// #define ADAPTIVE //Batch mode choosing between our and Regina's canonicaliser
+// #define QUERY //Looks the input up in the census.<rank>.idx files of a -DCENSUS_INDEX search
+// #define SERVICE //Answers requests on stdin, or on the Unix socket given as the only argument
 #define SEARCH
 
 template <int dim>
@@ -76,40 +87,9 @@ void output_stats(int number, std::ifstream& in,  std::ofstream& out) {
     #pragma omp parallel for
     for(int x = 0; x < number; x++) {
         Triangulation<dim>* triangulation = Triangulation<dim>::fromIsoSig(names[x]);
-        //Properties is an array of information
-        std::vector<SimplexInfo> properties;
-        for (int i = 0; i < triangulation->size(); i++) {
-            Simplex<dim>* tetrahedra = triangulation->simplex(i);
-            properties.emplace_back(SimplexInfo(tetrahedra, i, triangulation->size()));
-        }
-        std::sort(properties.begin(), properties.end());
+        //Number of configurations computeSignature needs to try
+        int combs = IsoSig::getCandidates(triangulation).size();
         delete triangulation;
-
-        //Iterate through and find shortest run
-        int prev = 0;
-        int current = 1;
-        std::vector<int> partition;
-        int combs = INT32_MAX;
-        for (int i = 1; i < properties.size(); i++) {
-            if (properties[prev] == properties[i]) {
-                current++;
-            } else {
-                partition.push_back(current);
-                prev = i;
-                current = 1;
-            }
-        }
-        partition.push_back(current);
-        //Compute statistics on how many configurations need to be used
-        int index = 0;
-        for (auto num : partition) {
-            int count = 0;
-            for (int i = 0; i < num; i++) {
-                count += properties[index].numOrderings<dim>();
-                index++;
-            }
-            combs = std::min(count, combs);
-        }
         #pragma omp critical
         hist[combs]++;
     }
@@ -119,6 +99,53 @@ void output_stats(int number, std::ifstream& in,  std::ofstream& out) {
     }
 }
 
+template <int dim>
+void query_census(int number, std::ifstream& in,  std::ofstream& out) {
+    std::vector<CensusIndex*> census = CensusIndex::openAll("census");
+    if (census.empty()) {
+        std::cerr << "No census index found" << std::endl;
+        return;
+    }
+    std::vector<std::string> names(number);
+    std::vector<std::string> sigs(number);
+    for(int x = 0; x < number; x++) {
+        in >> names[x];
+    }
+    #pragma omp parallel for schedule(dynamic)
+    for(int x = 0; x < number; x++) {
+        Triangulation<dim>* triangulation = Triangulation<dim>::fromIsoSig(names[x]);
+        if (triangulation) {
+            sigs[x] = IsoSig::computeSignature(triangulation);
+            delete triangulation;
+        }
+    }
+    //Input, its canonical signature and whether the census contains it
+    for(int x = 0; x < number; x++) {
+        bool found = sigs[x].size() > 0 && CensusIndex::shardFor(census, sigs[x])->contains(sigs[x]);
+        out << names[x] << " " << sigs[x] << " " << found << std::endl;
+    }
+    //Census entries by number of simplices
+    size_t total = 0;
+    for (auto shard : census) {
+        total += shard->size();
+    }
+    size_t counted = 0;
+    for (size_t n = 1; counted < total && n <= (1 << 20); n++) {
+        size_t count = 0;
+        for (auto shard : census) {
+            count += shard->countSize(n);
+        }
+        if (count > 0) {
+            out << "Size:" << n << " " << count << std::endl;
+        }
+        counted += count;
+    }
+    out << "Total:" << total << std::endl;
+    for (auto shard : census) {
+        delete shard;
+    }
+}
+
 template <int dim>
 void check_perf(int number, std::ifstream& in,  std::ofstream& out) {
     std::vector<Triangulation<dim>*> triangulations;
@@ -145,6 +172,11 @@ void check_perf(int number, std::ifstream& in,  std::ofstream& out) {
 }
 
 int main(int argc, char *argv[]) {
+#ifdef SERVICE
+    //Runs until its input closes or it is asked to quit; no input files or MPI
+    Service<3> service("census");
+    return service.run(argc > 1 ? argv[1] : "");
+#endif
     std::string inFile = std::string(argv[1]);
     std::string outFile = std::string(argv[2]);
     std::ifstream in (inFile, std::ifstream::in);
@@ -162,6 +194,28 @@ int main(int argc, char *argv[]) {
 #ifdef TIMING
     check_perf<4>(number, in, out);
 #endif
+#ifdef VERIFY
+    Verify::run<VERIFY>(number, in, out);
+#endif
+#ifdef QUERY
+    query_census<3>(number, in, out);
+#endif
+#ifdef BATCH
+    //Streams the remaining signatures (count above is ignored) into canonical form
+    bool dedup = false;
+#ifdef DEDUP
+    dedup = true;
+#endif
+#ifdef ADAPTIVE
+    CostModel model = CostModel::calibrate<3>();
+    std::cout << "Custom ns:" << model.customCost() << " Regina ns:" << model.reginaCost() << std::endl;
+    Batch::canonicaliseStream<3>(in, out, dedup, [&](Triangulation<3>* triangulation) {
+        return model.computeSignature(triangulation);
+    });
+#else
+    Batch::canonicaliseStream<3>(in, out, dedup);
+#endif
+#endif
 #ifdef SEARCH
     std::vector<std::string> names;
     int maxHeight;
@@ -0,0 +1,156 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+#include <string>
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+
+#include "threadslots.h"
+
+/* Runtime memory accounting for the search against the budget in the environment
+ * variable SEARCH_MEMORY_BUDGET (bytes, with an optional K, M, G or T suffix).
+ * The visited set, frontier, send batches and cached triangulations report estimated
+ * sizes into per-thread slots (see ThreadSlots), and update() sums them from the
+ * search loop. As usage nears the budget the storage level only rises:
+ *  - DropCache: cached Triangulation*s are freed and no more are cached;
+ *  - Compress:  new frontier entries are packed at 6 bits per character;
+ *  - Spill:     new frontier entries are written to disk.
+ * Without a budget nothing is cached, as with the old MEM_LIMITS build, and the
+ * level stays at Full.
+*/
+class MemoryGovernor {
+public:
+    enum Account {
+        VisitedSet,
+        Queue,
+        SendBatch,
+        Cache,
+        nAccounts
+    };
+    enum Level {
+        Full,
+        DropCache,
+        Compress,
+        Spill
+    };
+
+private:
+    //Milliseconds between updates of the level
+    static const int interval = 100;
+
+    struct alignas(64) Slot {
+        std::atomic<int64_t> bytes[nAccounts];
+    };
+    typedef ThreadSlots<Slot> Slots;
+
+    MemoryGovernor();
+
+    static std::atomic<int>& currentLevel() {
+        static std::atomic<int> level(Full);
+        return level;
+    }
+
+    static std::chrono::steady_clock::time_point& lastUpdate() {
+        static std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+        return last;
+    }
+
+    static size_t parseBudget() {
+        const char* value = std::getenv("SEARCH_MEMORY_BUDGET");
+        if (! value) {
+            return 0;
+        }
+        char* suffix;
+        size_t budget = std::strtoull(value, &suffix, 10);
+        size_t unit = std::string("KMGT").find(std::toupper(*suffix));
+        if (*suffix && unit != std::string::npos) {
+            budget <<= 10 * (unit + 1);
+        }
+        return budget;
+    }
+
+    static const char* levelName(int level) {
+        static const char* names[] = {"full", "drop_cache", "compress", "spill"};
+        return names[level];
+    }
+
+public:
+    //Fractions of the budget at which each level starts
+    static constexpr double dropCacheAt = 0.7;
+    static constexpr double compressAt = 0.8;
+    static constexpr double spillAt = 0.9;
+
+    static size_t budget() {
+        static size_t budget = parseBudget();
+        return budget;
+    }
+
+    //bytes is negative when memory is freed
+    static void add(Account account, int64_t bytes) {
+        Slots::local().bytes[account].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    static size_t used() {
+        int64_t total = 0;
+        for (int i = 0; i < Slots::maxThreads; i++) {
+            for (int a = 0; a < nAccounts; a++) {
+                total += Slots::at(i).bytes[a].load(std::memory_order_relaxed);
+            }
+        }
+        return total > 0 ? total : 0;
+    }
+
+    static Level level() {
+        return (Level)currentLevel().load(std::memory_order_relaxed);
+    }
+
+    //Whether the triangulations of new nodes should be kept until they are expanded
+    static bool cacheTriangulations() {
+        return budget() > 0 && level() < DropCache;
+    }
+
+    //Whether an update is due; called from a single thread
+    static bool due() {
+        return budget() > 0 && std::chrono::steady_clock::now() - lastUpdate() >= std::chrono::milliseconds(interval);
+    }
+
+    //Raises the level to match current usage and returns it
+    static Level update() {
+        lastUpdate() = std::chrono::steady_clock::now();
+        if (budget() == 0) {
+            return Full;
+        }
+        double fraction = (double)used() / budget();
+        int target = fraction >= spillAt ? Spill : fraction >= compressAt ? Compress
+            : fraction >= dropCacheAt ? DropCache : Full;
+        int previous = currentLevel().load();
+        if (target > previous) {
+            currentLevel().store(target);
+            std::cerr << "Memory level:" << levelName(target) << " used:" << used()
+                << " budget:" << budget() << std::endl;
+        }
+        return level();
+    }
+
+    //Estimated heap footprint of a string held in a container node
+    static size_t stringBytes(const std::string& s) {
+        //Short strings are stored inside the object
+        return sizeof(std::string) + (s.capacity() > 15 ? s.capacity() + 1 : 0);
+    }
+
+    //Estimated footprint of a hash set or map entry: node links, cached hash and a bucket
+    static size_t entryBytes(const std::string& s, size_t value = 0) {
+        return stringBytes(s) + value + 3 * sizeof(void*);
+    }
+
+    //Estimated footprint of a triangulation, counting its skeleton as much again as its simplices
+    template <class T>
+    static size_t triangulationBytes(T* triangulation) {
+        return sizeof(*triangulation) + 2 * triangulation->size() * sizeof(*triangulation->simplex(0));
+    }
+};
+
+#endif
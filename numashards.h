@@ -0,0 +1,209 @@
+#ifndef NUMA_SHARDS_H
+#define NUMA_SHARDS_H
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+#include <sched.h>
+#include <omp.h>
+
+#include "boundedqueue.h"
+#include "stats.h"
+#include "memory.h"
+#include "sighash.h"
+
+/* Visited set of one rank split into a shard per NUMA domain (enabled with
+ * -DNUMA_SHARDS, make numa). A signature is owned by the shard picked by its
+ * hash. Each worker thread is pinned to a CPU of one domain on first use.
+ * Only the CPUs this process may run on (sched_getaffinity, e.g. under taskset or
+ * a cgroup cpuset) are used, and domains with none of them get no shard.
+ * Signatures owned by another domain are handed to that domain's inbox rather
+ * than inserted remotely, and each domain's threads drain their own inbox. Shard
+ * memory is therefore allocated and touched by threads of its own domain.
+ * This intends one rank per node; ranks sharing a node would pin to the same CPUs.
+*/
+class NumaShards {
+private:
+    static const int inboxCapacity = 1 << 14;
+
+    struct Shard {
+        std::vector<int> cpus;
+        std::mutex lock;
+        std::unordered_set<std::string> sigs;
+        BoundedQueue<std::string*> inbox;
+
+        Shard() : inbox(inboxCapacity) {}
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t hashDivisor;
+    //Signatures handed to an inbox and not yet inserted, counted from before the push
+    //until after the insert so idle() cannot miss one held by a draining thread
+    std::atomic<int> handedOff;
+
+    //CPU lists of the NUMA nodes, e.g. "0-15,32-47", keeping only the CPUs this process is allowed
+    static std::vector<std::vector<int>> readDomains() {
+        std::vector<std::vector<int>> domains;
+        cpu_set_t allowed;
+        bool known = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        for (int node = 0; ; node++) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (! in) {
+                break;
+            }
+            std::vector<int> cpus;
+            std::string range;
+            while (std::getline(in, range, ',')) {
+                int lo, hi;
+                char dash;
+                std::istringstream parse(range);
+                parse >> lo;
+                if (parse >> dash >> hi) {
+                    for (int cpu = lo; cpu <= hi; cpu++) {
+                        cpus.push_back(cpu);
+                    }
+                } else {
+                    cpus.push_back(lo);
+                }
+            }
+            if (known) {
+                cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&](int cpu) {
+                    return cpu >= CPU_SETSIZE || ! CPU_ISSET(cpu, &allowed);
+                }), cpus.end());
+            }
+            if (! cpus.empty()) {
+                domains.push_back(cpus);
+            }
+        }
+        return domains;
+    }
+
+    //Domain of the calling thread, pinning it to one of that domain's CPUs the first time
+    int myDomain() {
+        thread_local int domain = -1;
+        if (domain < 0) {
+            int thread = omp_get_thread_num();
+            domain = thread % shards.size();
+            std::vector<int>& cpus = shards[domain]->cpus;
+            if (! cpus.empty()) {
+                int cpu = cpus[(thread / shards.size()) % cpus.size()];
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu, &set);
+                if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                    #pragma omp critical(output)
+                    std::cerr << "Failed to pin thread " << thread << " to CPU " << cpu << ": "
+                        << std::strerror(errno) << std::endl;
+                }
+            }
+        }
+        return domain;
+    }
+
+    //Inserts into the shard, queueing the signature for processing if it is new
+    template <class U>
+    void insert(Shard& shard, const std::string& s, U& processingQueue) {
+        bool inserted;
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            inserted = shard.sigs.insert(s).second;
+        }
+        if (inserted) {
+            MemoryGovernor::add(MemoryGovernor::VisitedSet, MemoryGovernor::entryBytes(s));
+            #pragma omp critical(sig)
+            processingQueue.push(s);
+        } else {
+            STATS_ADD(Stats::Duplicates, 1);
+        }
+    }
+
+public:
+    //nComp is the number of ranks; shards use the hash bits above those picking the rank
+    NumaShards(int nComp) : hashDivisor(nComp), handedOff(0) {
+        std::vector<std::vector<int>> domains = readDomains();
+        //Every domain needs a thread to drain its inbox
+        int count = std::max(1, std::min((int)domains.size(), omp_get_max_threads()));
+        for (int i = 0; i < count; i++) {
+            shards.emplace_back(new Shard());
+            if (i < (int)domains.size()) {
+                shards[i]->cpus = domains[i];
+            }
+        }
+    }
+
+    ~NumaShards() {
+        std::string* s;
+        for (auto& shard : shards) {
+            while (shard->inbox.tryPop(s)) {
+                delete s;
+            }
+        }
+    }
+
+    //Adds a signature owned by this rank, handing it to its domain if that is not ours
+    template <class U>
+    void submit(const std::string& s, U& processingQueue) {
+        int owner = (SigHash::hash(s) / hashDivisor) % shards.size();
+        int domain = myDomain();
+        if (owner == domain) {
+            insert(*shards[owner], s, processingQueue);
+            return;
+        }
+        std::string* handoff = new std::string(s);
+        handedOff++;
+        if (! shards[owner]->inbox.tryPush(handoff)) {
+            //Inbox full: insert remotely rather than wait
+            delete handoff;
+            insert(*shards[owner], s, processingQueue);
+            handedOff--;
+        }
+    }
+
+    //Inserts the signatures handed to the calling thread's domain
+    template <class U>
+    void drain(U& processingQueue) {
+        Shard& shard = *shards[myDomain()];
+        std::string* s;
+        while (shard.inbox.tryPop(s)) {
+            insert(shard, *s, processingQueue);
+            delete s;
+            handedOff--;
+        }
+    }
+
+    //Whether every handed off signature has been inserted
+    bool idle() const {
+        return handedOff.load() == 0;
+    }
+
+    //Moves every signature out of the shards, leaving them empty
+    void release(std::vector<std::string>& out) {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            while (! shard->sigs.empty()) {
+                out.push_back(std::move(shard->sigs.extract(shard->sigs.begin()).value()));
+            }
+        }
+    }
+
+    size_t size() {
+        size_t total = 0;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> guard(shard->lock);
+            total += shard->sigs.size();
+        }
+        return total;
+    }
+};
+
+#endif
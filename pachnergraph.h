@@ -0,0 +1,306 @@
+#ifndef PACHNER_GRAPH_H
+#define PACHNER_GRAPH_H
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+#include <mpi.h>
+
+#include "varint.h"
+#include "sighash.h"
+
+/* Export of the Pachner graph found by the search (enabled with -DPACHNER_GRAPH,
+ * make graph). While searching, each rank appends the edges of the nodes it expands
+ * to edges.<rank>.bin: the source signature, then a move type and a canonical
+ * destination for every neighbour getPachnerMoves produced. The move type is the
+ * dimension of the face the move is performed on.
+ *
+ * At the end every rank numbers the signatures it owns in sorted order, after those
+ * of lower ranks (so with -DCENSUS_INDEX an ID is the shard's offset plus the position
+ * in census.<rank>.idx). Destinations are numbered by asking their owners in an
+ * all-to-all exchange, split into rounds so MPI's int counts never overflow. Each rank then writes its rows of pachner.graph with MPI-IO:
+ *  - Header;
+ *  - uint64 shardOffsets[nShards + 1], the first ID of each rank's nodes;
+ *  - uint64 rowPtr[nNodes + 1];
+ *  - uint64 cols[nEdges], the destination IDs;
+ *  - uint8 types[nEdges].
+ * Every section starts 8-byte aligned, so the file can be mapped and used in place.
+ * Integers are stored in native byte order. Each move is a separate edge, so two
+ * moves giving the same neighbour are both kept.
+*/
+class PachnerGraph {
+private:
+    static const uint32_t version = 1;
+    //Largest single MPI-IO write or exchange round, keeping counts within an int
+    static const size_t maxWrite = 1 << 30;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t dim;
+        uint32_t nShards;
+        uint32_t reserved;
+        uint64_t nNodes;
+        uint64_t nEdges;
+    };
+
+    PachnerGraph();
+
+    static std::string edgePath(int rank) {
+        return "edges." + std::to_string(rank) + ".bin";
+    }
+
+    static std::ofstream& edges(int rank) {
+        static std::ofstream out(edgePath(rank), std::ios::binary | std::ios::trunc);
+        return out;
+    }
+
+    static std::string getString(std::istream& in) {
+        std::string s(Varint::get(in), '\0');
+        in.read(&s[0], s.size());
+        return s;
+    }
+
+    //Calls f(src, dst, type) for every edge this rank recorded
+    template <class F>
+    static void forEachEdge(int rank, F f) {
+        std::ifstream in(edgePath(rank), std::ios::binary);
+        while (in.peek() != EOF) {
+            std::string src = getString(in);
+            size_t count = Varint::get(in);
+            for (size_t i = 0; i < count; i++) {
+                int type = in.get();
+                std::string dst = getString(in);
+                f(src, dst, type);
+            }
+        }
+    }
+
+    static size_t position(const std::vector<std::string>& sorted, const std::string& sig) {
+        return std::lower_bound(sorted.begin(), sorted.end(), sig) - sorted.begin();
+    }
+
+    static int owner(const std::string& sig, int nComp) {
+        return SigHash::owner(sig, nComp);
+    }
+
+    static void writeAt(MPI_File file, uint64_t offset, const void* data, size_t bytes) {
+        const char* p = (const char*)data;
+        while (bytes > 0) {
+            size_t n = bytes < maxWrite ? bytes : maxWrite;
+            MPI_File_write_at(file, offset, p, (int)n, MPI_BYTE, MPI_STATUS_IGNORE);
+            offset += n;
+            p += n;
+            bytes -= n;
+        }
+    }
+
+    //MPI_Alltoallv with 64-bit counts and displacements (in elements of type T). Every
+    //rank sends at most maxWrite bytes in total per round, staged in contiguous buffers.
+    template <class T>
+    static void alltoallv(const T* send, const std::vector<uint64_t>& sendCounts,
+            const std::vector<uint64_t>& sendDispls, T* recv, const std::vector<uint64_t>& recvCounts,
+            const std::vector<uint64_t>& recvDispls, MPI_Datatype type, int nComp) {
+        uint64_t chunk = std::max<uint64_t>(1, maxWrite / sizeof(T) / nComp);
+        uint64_t largest = 0;
+        for (int r = 0; r < nComp; r++) {
+            largest = std::max(largest, std::max(sendCounts[r], recvCounts[r]));
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &largest, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+        std::vector<int> counts(nComp), displs(nComp), roundRecvCounts(nComp), roundRecvDispls(nComp);
+        std::vector<T> sendRound, recvRound;
+        for (uint64_t done = 0; done < largest; done += chunk) {
+            sendRound.clear();
+            int received = 0;
+            for (int r = 0; r < nComp; r++) {
+                uint64_t n = sendCounts[r] > done ? std::min(chunk, sendCounts[r] - done) : 0;
+                displs[r] = sendRound.size();
+                counts[r] = n;
+                sendRound.insert(sendRound.end(), send + sendDispls[r] + done, send + sendDispls[r] + done + n);
+                roundRecvCounts[r] = recvCounts[r] > done ? std::min(chunk, recvCounts[r] - done) : 0;
+                roundRecvDispls[r] = received;
+                received += roundRecvCounts[r];
+            }
+            recvRound.resize(received);
+            MPI_Alltoallv(sendRound.data(), counts.data(), displs.data(), type,
+                recvRound.data(), roundRecvCounts.data(), roundRecvDispls.data(), type, MPI_COMM_WORLD);
+            for (int r = 0; r < nComp; r++) {
+                std::copy(recvRound.begin() + roundRecvDispls[r],
+                    recvRound.begin() + roundRecvDispls[r] + roundRecvCounts[r], recv + recvDispls[r] + done);
+            }
+        }
+    }
+
+    static void exclusiveSum(uint64_t value, uint64_t& before, int rank) {
+        MPI_Exscan(&value, &before, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+        //Exscan leaves rank 0's result undefined
+        if (rank == 0) {
+            before = 0;
+        }
+    }
+
+public:
+    //Appends the edges from src to its canonical neighbours; faces[i] is the move type of dsts[i]
+    static void record(const std::string& src, const std::vector<std::string>& dsts,
+            const std::vector<int>& faces, int rank) {
+        std::string buffer;
+        Varint::put(buffer, src.size());
+        buffer += src;
+        Varint::put(buffer, dsts.size());
+        for (size_t i = 0; i < dsts.size(); i++) {
+            buffer += (char)faces[i];
+            Varint::put(buffer, dsts[i].size());
+            buffer += dsts[i];
+        }
+        #pragma omp critical(graph)
+        edges(rank).write(buffer.data(), buffer.size());
+    }
+
+    //Collective: builds pachner.graph from the recorded edges. sigs are the signatures
+    //this rank owns, in sorted order.
+    template <int dim>
+    static void write(const std::vector<std::string>& sigs, int rank, int nComp) {
+        edges(rank).close();
+
+        //Degree of each owned node, and the destinations each owner must number
+        std::vector<uint64_t> rowPtr(sigs.size() + 1, 0);
+        std::vector<std::unordered_set<std::string>> asked(nComp);
+        forEachEdge(rank, [&](const std::string& src, const std::string& dst, int) {
+            rowPtr[position(sigs, src) + 1]++;
+            asked[owner(dst, nComp)].insert(dst);
+        });
+        std::vector<std::vector<std::string>> requests(nComp);
+        std::vector<uint64_t> sendCounts(nComp);
+        std::vector<uint64_t> sendDispls(nComp);
+        std::string sendBuffer;
+        for (int r = 0; r < nComp; r++) {
+            requests[r].assign(asked[r].begin(), asked[r].end());
+            std::unordered_set<std::string>().swap(asked[r]);
+            std::sort(requests[r].begin(), requests[r].end());
+            sendDispls[r] = sendBuffer.size();
+            for (auto& s : requests[r]) {
+                sendBuffer += s;
+                sendBuffer += '\0';
+            }
+            sendCounts[r] = sendBuffer.size() - sendDispls[r];
+        }
+        std::vector<uint64_t> recvCounts(nComp);
+        std::vector<uint64_t> recvDispls(nComp);
+        MPI_Alltoall(sendCounts.data(), 1, MPI_UINT64_T, recvCounts.data(), 1, MPI_UINT64_T, MPI_COMM_WORLD);
+        uint64_t received = 0;
+        for (int r = 0; r < nComp; r++) {
+            recvDispls[r] = received;
+            received += recvCounts[r];
+        }
+        std::vector<char> recvBuffer(received);
+        alltoallv(sendBuffer.data(), sendCounts, sendDispls, recvBuffer.data(), recvCounts, recvDispls,
+            MPI_CHAR, nComp);
+        std::string().swap(sendBuffer);
+
+        //Answer with the IDs of the signatures asked for, in the order asked
+        uint64_t nodeOffset;
+        exclusiveSum(sigs.size(), nodeOffset, rank);
+        std::vector<uint64_t> answers;
+        std::vector<uint64_t> answerCounts(nComp);
+        std::vector<uint64_t> answerDispls(nComp);
+        for (int r = 0; r < nComp; r++) {
+            answerDispls[r] = answers.size();
+            const char* p = recvBuffer.data() + recvDispls[r];
+            const char* end = p + recvCounts[r];
+            while (p < end) {
+                std::string s(p);
+                p += s.size() + 1;
+                answers.push_back(nodeOffset + position(sigs, s));
+            }
+            answerCounts[r] = answers.size() - answerDispls[r];
+        }
+        std::vector<char>().swap(recvBuffer);
+        std::vector<uint64_t> idCounts(nComp);
+        std::vector<uint64_t> idDispls(nComp);
+        uint64_t nIds = 0;
+        for (int r = 0; r < nComp; r++) {
+            idCounts[r] = requests[r].size();
+            idDispls[r] = nIds;
+            nIds += idCounts[r];
+        }
+        std::vector<uint64_t> ids(nIds);
+        alltoallv(answers.data(), answerCounts, answerDispls, ids.data(), idCounts, idDispls,
+            MPI_UINT64_T, nComp);
+        std::vector<uint64_t>().swap(answers);
+
+        //Fill the rows
+        for (size_t i = 0; i < sigs.size(); i++) {
+            rowPtr[i + 1] += rowPtr[i];
+        }
+        uint64_t nEdges = rowPtr.back();
+        std::vector<uint64_t> cols(nEdges);
+        std::vector<uint8_t> types(nEdges);
+        std::vector<uint64_t> next(rowPtr.begin(), rowPtr.end() - 1);
+        forEachEdge(rank, [&](const std::string& src, const std::string& dst, int type) {
+            uint64_t& slot = next[position(sigs, src)];
+            int r = owner(dst, nComp);
+            cols[slot] = ids[idDispls[r] + position(requests[r], dst)];
+            types[slot] = type;
+            slot++;
+        });
+        std::remove(edgePath(rank).c_str());
+
+        //Place this rank's rows after those of lower ranks
+        uint64_t edgeOffset;
+        exclusiveSum(nEdges, edgeOffset, rank);
+        uint64_t local[2] = {sigs.size(), nEdges};
+        uint64_t totals[2];
+        MPI_Allreduce(local, totals, 2, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+        std::vector<uint64_t> shardOffsets(nComp + 1);
+        MPI_Allgather(&nodeOffset, 1, MPI_UINT64_T, shardOffsets.data(), 1, MPI_UINT64_T, MPI_COMM_WORLD);
+        shardOffsets[nComp] = totals[0];
+        for (auto& row : rowPtr) {
+            row += edgeOffset;
+        }
+        uint64_t rowStart = sizeof(Header) + sizeof(uint64_t) * (nComp + 1);
+        uint64_t colStart = rowStart + sizeof(uint64_t) * (totals[0] + 1);
+        uint64_t typeStart = colStart + sizeof(uint64_t) * totals[1];
+
+        MPI_File file;
+        int opened = MPI_File_open(MPI_COMM_WORLD, "pachner.graph", MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                MPI_INFO_NULL, &file) == MPI_SUCCESS;
+        //Setting the size and closing are collective, so every rank gives up if any failed to open
+        int allOpened;
+        MPI_Allreduce(&opened, &allOpened, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (! allOpened) {
+            if (opened) {
+                MPI_File_close(&file);
+            } else {
+                std::cerr << "Failed to open pachner.graph Rank:" << rank << std::endl;
+            }
+            return;
+        }
+        MPI_File_set_size(file, typeStart + totals[1]);
+        if (rank == 0) {
+            Header header = {};
+            std::memcpy(header.magic, "TRIPACHG", sizeof(header.magic));
+            header.version = version;
+            header.dim = dim;
+            header.nShards = nComp;
+            header.nNodes = totals[0];
+            header.nEdges = totals[1];
+            writeAt(file, 0, &header, sizeof(header));
+            writeAt(file, sizeof(header), shardOffsets.data(), sizeof(uint64_t) * shardOffsets.size());
+        }
+        //A rank's last row end is the next rank's first row start, so only the last rank writes it
+        size_t rows = sigs.size() + (rank == nComp - 1 ? 1 : 0);
+        writeAt(file, rowStart + sizeof(uint64_t) * nodeOffset, rowPtr.data(), sizeof(uint64_t) * rows);
+        writeAt(file, colStart + sizeof(uint64_t) * edgeOffset, cols.data(), sizeof(uint64_t) * nEdges);
+        writeAt(file, typeStart + edgeOffset, types.data(), nEdges);
+        MPI_File_close(&file);
+    }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef PERM_TABLES_H
+#define PERM_TABLES_H
+#include <cstdint>
+
+/* Compile time lookup tables over permutation indices, so that the isoSig walk
+ * can compose, invert and apply permutations with table lookups only.
+ * Indices follow Perm<n>::index() / Perm<n>::atIndex(), i.e. Regina's Sn
+ * ordering: lexicographic, except that adjacent pairs are swapped where needed
+ * so that even permutations have even indices.
+*/
+template <int n>
+class PermTable {
+    static_assert(n >= 2 && n <= 5, "Tables are only generated for Perm<2> to Perm<5>");
+public:
+    static constexpr int nPerms = (n == 2 ? 2 : n == 3 ? 6 : n == 4 ? 24 : 120);
+
+    //image[p][i] is p[i] and preImage[p][i] is p.preImageOf(i)
+    uint8_t image[nPerms][n];
+    uint8_t preImage[nPerms][n];
+    //inverse[p] is the index of p.inverse()
+    uint8_t inverse[nPerms];
+    //compose[p][q] is the index of p * q, i.e. i -> p[q[i]]
+    uint8_t compose[nPerms][nPerms];
+
+    constexpr PermTable() : image{}, preImage{}, inverse{}, compose{} {
+        for (int p = 0; p < nPerms; p++) {
+            int lex = p;
+            fromLex(lex, image[p]);
+            if (isEven(image[p]) != (p % 2 == 0)) {
+                fromLex(lex ^ 1, image[p]);
+            }
+            for (int i = 0; i < n; i++) {
+                preImage[p][image[p][i]] = i;
+            }
+        }
+        for (int p = 0; p < nPerms; p++) {
+            inverse[p] = indexOf(preImage[p]);
+            for (int q = 0; q < nPerms; q++) {
+                uint8_t product[n] = {};
+                for (int i = 0; i < n; i++) {
+                    product[i] = image[p][image[q][i]];
+                }
+                compose[p][q] = indexOf(product);
+            }
+        }
+    }
+
+private:
+    //Writes the lex-th permutation in lexicographic order into img
+    static constexpr void fromLex(int lex, uint8_t* img) {
+        int digits[n] = {};
+        for (int i = n - 1; i >= 0; i--) {
+            digits[i] = lex % (n - i);
+            lex /= (n - i);
+        }
+        bool used[n] = {};
+        for (int i = 0; i < n; i++) {
+            int skip = digits[i];
+            for (int v = 0; v < n; v++) {
+                if (used[v]) {
+                    continue;
+                }
+                if (skip == 0) {
+                    img[i] = v;
+                    used[v] = true;
+                    break;
+                }
+                skip--;
+            }
+        }
+    }
+
+    static constexpr bool isEven(const uint8_t* img) {
+        int inversions = 0;
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                if (img[i] > img[j]) {
+                    inversions++;
+                }
+            }
+        }
+        return inversions % 2 == 0;
+    }
+
+    static constexpr uint8_t indexOf(const uint8_t* img) {
+        int lex = 0;
+        for (int i = 0; i < n; i++) {
+            int smaller = 0;
+            for (int j = i + 1; j < n; j++) {
+                if (img[j] < img[i]) {
+                    smaller++;
+                }
+            }
+            lex = lex * (n - i) + smaller;
+        }
+        return (isEven(img) == (lex % 2 == 0)) ? lex : (lex ^ 1);
+    }
+};
+
+template <int n>
+inline constexpr PermTable<n> permTable = PermTable<n>();
+
+#endif
@@ -18,7 +18,10 @@
 #include<triangulation/detail/triangulation.h>
 #include<triangulation/detail/isosig-impl.h>
 
-#define MEM_LIMITS 1
+#include "stats.h"
+#include "memory.h"
+#include "frontier.h"
+
 /* Warning: Sigset and processqueue share lock called processqueue
 */
 
@@ -31,53 +34,89 @@ private:
     template <int dim, class T, class U>
     static void processNode(T& sigSet, U& processingQueue, int tLimit) {
         std::string sig;
+        Triangulation<dim>* t = nullptr;
         #pragma omp critical(sig)
         {
             if (processingQueue.size() > 0) {
                 sig = processingQueue.front();
                 processingQueue.pop();
+                //A cached triangulation is only needed for this expansion
+                auto cached = sigSet.find(sig);
+                if (cached != sigSet.end() && cached->second) {
+                    t = cached->second;
+                    cached->second = nullptr;
+                    MemoryGovernor::add(MemoryGovernor::Cache, -(int64_t)MemoryGovernor::triangulationBytes(t));
+                }
             }
         }
         if (sig.size() == 0) {
             return;
         }
-    #ifdef MEM_LIMITS
-        Triangulation<dim>* t = Triangulation<dim>::fromIsoSig(sig);
-    #else
-        Triangulation<dim>* t = sigSet[sig];
-    #endif
+        STATS_ADD(Stats::NodesExpanded, 1);
+        STATS_START(decode);
+        if (! t) {
+            t = Triangulation<dim>::fromIsoSig(sig);
+        }
+        STATS_STOP(decode, Stats::Decode);
+        STATS_START(moves);
         std::vector<Triangulation<dim>*> adj = getPachnerMoves(t, tLimit);
+        STATS_STOP(moves, Stats::Moves);
         //Convert all to sigs and add to processingQueue + sigSet
         for (auto tri : adj) {
+            STATS_START(canonicalise);
             std::string s = IsoSig::computeSignature(tri);
+            STATS_STOP(canonicalise, Stats::Canonicalise);
+            STATS_START(dedup);
             #pragma omp critical(sig)
             {
                 if (sigSet.count(s) == 0) { //New triangulation
-                #ifdef MEM_LIMITS
-                    sigSet.insert(s);
-                    delete tri;
-                #else
-                    sigSet[s] = tri;
-                #endif
+                    MemoryGovernor::add(MemoryGovernor::VisitedSet, MemoryGovernor::entryBytes(s, sizeof(tri)));
+                    if (MemoryGovernor::cacheTriangulations()) {
+                        sigSet[s] = tri;
+                        MemoryGovernor::add(MemoryGovernor::Cache, MemoryGovernor::triangulationBytes(tri));
+                    } else {
+                        sigSet[s] = nullptr;
+                        delete tri;
+                    }
                     processingQueue.push(s);
                     std::cout << s << std::endl;
                 } else { //Duplicate triangulation found
+                    STATS_ADD(Stats::Duplicates, 1);
                     delete tri;
                 }
             }
+            STATS_STOP(dedup, Stats::Dedup);
         }
         //Deleting triangulation occurs after it has been processed
         delete t;        
     }
+
+    //Frees the cached triangulations, leaving the signatures
+    template <int dim>
+    static void dropCache(std::unordered_map<std::string, Triangulation<dim>*>& sigSet) {
+        #pragma omp critical(sig)
+        for (auto& entry : sigSet) {
+            if (entry.second) {
+                MemoryGovernor::add(MemoryGovernor::Cache, -(int64_t)MemoryGovernor::triangulationBytes(entry.second));
+                delete entry.second;
+                entry.second = nullptr;
+            }
+        }
+    }
+
 public:   
-    static std::vector<Triangulation<3>*> getPachnerMoves (Triangulation<3>* t, int tLimit) {
-        std::vector<Triangulation<3>*> adj;
+    //Calls f(neighbour, face) for each neighbour of t under Pachner moves, not exceeding
+    //tLimit simplices, as soon as it is built; face is the dimension of the face the move
+    //is performed on. f takes ownership of the neighbour.
+    template <class F>
+    static void forEachPachnerMove(Triangulation<3>* t, int tLimit, F f) {
         //Get all copies of tetrahedra made using 3-2 moves
         for (int i = 0; i < t->countEdges(); i++) {
             if (t->pachner(t->edge(i), true, false)) {
                 Triangulation<3>* alt = new Triangulation<3>(*t, false);
                 alt->pachner(alt->edge(i), false, true);
-                adj.push_back(alt);
+                STATS_ADD(Stats::neighbours(1), 1);
+                f(alt, 1);
             }
         }
         //Get all copies of tetrahedra made using 2-3 moves
@@ -86,21 +125,22 @@ public:
                 if (t->pachner(t->triangle(i), true, false)) {
                     Triangulation<3>* alt = new Triangulation<3>(*t, false);
                     alt->pachner(alt->triangle(i), false, true);
-                    adj.push_back(alt);
+                    STATS_ADD(Stats::neighbours(2), 1);
+                    f(alt, 2);
                 }           
             }     
         }
-        return adj;
     }
 
-    static std::vector<Triangulation<4>*> getPachnerMoves (Triangulation<4>* t, int tLimit) {
-        std::vector<Triangulation<4>*> adj;
+    template <class F>
+    static void forEachPachnerMove(Triangulation<4>* t, int tLimit, F f) {
         //5-1 move
         for (int i = 0; i < t->countVertices(); i++) {
             if (t->pachner(t->vertex(i), true, false)) {
                 Triangulation<4>* alt = new Triangulation<4>(*t, false);
                 alt->pachner(alt->vertex(i), false, true);
-                adj.push_back(alt);
+                STATS_ADD(Stats::neighbours(0), 1);
+                f(alt, 0);
             }
         }
         //4-2 move
@@ -108,7 +148,8 @@ public:
             if (t->pachner(t->edge(i), true, false)) {
                 Triangulation<4>* alt = new Triangulation<4>(*t, false);
                 alt->pachner(alt->edge(i), false, true);
-                adj.push_back(alt);
+                STATS_ADD(Stats::neighbours(1), 1);
+                f(alt, 1);
             }
         }        
         //3-3 move
@@ -116,7 +157,8 @@ public:
             if (t->pachner(t->triangle(i), true, false)) {
                 Triangulation<4>* alt = new Triangulation<4>(*t, false);
                 alt->pachner(alt->triangle(i), false, true);
-                adj.push_back(alt);
+                STATS_ADD(Stats::neighbours(2), 1);
+                f(alt, 2);
             }
         }       
         //2-4 move
@@ -125,7 +167,8 @@ public:
                 if (t->pachner(t->tetrahedron(i), true, false)) {
                     Triangulation<4>* alt = new Triangulation<4>(*t, false);
                     alt->pachner(alt->tetrahedron(i), false, true);
-                    adj.push_back(alt);
+                    STATS_ADD(Stats::neighbours(3), 1);
+                    f(alt, 3);
                 }
             }        
         }
@@ -134,27 +177,36 @@ public:
             for (int i = 0; i < t->size(); i++) {
                 Triangulation<4>* alt = new Triangulation<4>(*t, false);
                 alt->pachner(alt->pentachoron(i), false, true);
-                adj.push_back(alt);
+                STATS_ADD(Stats::neighbours(4), 1);
+                f(alt, 4);
             }        
         }
-        return adj;        
+    }
+
+    //Neighbours of t under Pachner moves, not exceeding tLimit simplices. If faces is
+    //given, the dimension of the face each move is performed on is appended to it.
+    template <int dim>
+    static std::vector<Triangulation<dim>*> getPachnerMoves(Triangulation<dim>* t, int tLimit,
+            std::vector<int>* faces = nullptr) {
+        std::vector<Triangulation<dim>*> adj;
+        forEachPachnerMove(t, tLimit, [&](Triangulation<dim>* alt, int face) {
+            adj.push_back(alt);
+            if (faces) {
+                faces->push_back(face);
+            }
+        });
+        return adj;
     }
 
     template <int dim>
     static void searchExhaustive(std::vector<std::string> & start, int tLimit, int sizeLimit) {
-    #ifdef MEM_LIMITS
-        std::unordered_set<std::string> sigSet;
-    #else
+        //Triangulations are cached until expanded only while under the memory budget
         std::unordered_map<std::string, Triangulation<dim>*> sigSet;
-    #endif
         //(MPI)Must receive into this queue when message received
-        std::queue<std::string> processingQueue;
+        Frontier processingQueue;
+        bool cacheDropped = false;
         for (auto name : start) {
-        #ifdef MEM_LIMITS
-            sigSet.insert(name);
-        #else
-            sigSet[name] = Triangulation<dim>::fromIsoSig(name);
-        #endif
+            sigSet[name] = nullptr;
             processingQueue.push(name);
             std::cout << name << std::endl;
         }
@@ -163,6 +215,10 @@ public:
         {
             //Caution, if processing queue becomes empty on main thread
             while(!processingQueue.empty() || sigSet.size() < sizeLimit) {
+                if (MemoryGovernor::due() && MemoryGovernor::update() >= MemoryGovernor::DropCache && ! cacheDropped) {
+                    dropCache<dim>(sigSet);
+                    cacheDropped = true;
+                }
                 #pragma omp task
                 {
                     processNode<dim>(sigSet, processingQueue, tLimit);
@@ -172,6 +228,7 @@ public:
         }
         std::cout << processingQueue.size() << std::endl;
         std::cout << sigSet.size() << std::endl;
+        dropCache<dim>(sigSet);
     }
 };
 #endif
\ No newline at end of file
@@ -1,6 +1,11 @@
 #ifndef SEARCH_PARALLEL_H
 #define SEARCH_PARALLEL_H
 #include "search.h"
+#include "boundedqueue.h"
+#include "numashards.h"
+#include "census.h"
+#include "pachnergraph.h"
+#include "sighash.h"
 
 using namespace regina;
 class SearchParallel {
@@ -11,8 +16,101 @@ class SearchParallel {
     static const int wait = 1000000;
     static const int tag = 0;
     static const int tag1 = 1;
+    //(PIPELINE) Neighbours buffered between expansion and canonicalisation,
+    //and how many a canonicalisation task takes at once
+    static const int pipelineCapacity = 4096;
+    static const int pipelineBatch = 16;
     SearchParallel();
 
+    //(PIPELINE) Neighbour triangulations waiting to be canonicalised
+    template <int dim>
+    static BoundedQueue<Triangulation<dim>*>& neighbourQueue() {
+        static BoundedQueue<Triangulation<dim>*> queue(pipelineCapacity);
+        return queue;
+    }
+
+    //Expansion tasks spawned but not yet finished
+    static std::atomic<int>& expanding() {
+        static std::atomic<int> count(0);
+        return count;
+    }
+
+    //(PIPELINE) Canonicalisation tasks spawned but not yet finished
+    static std::atomic<int>& canonicalising() {
+        static std::atomic<int> count(0);
+        return count;
+    }
+
+    //Whether no node is being expanded and no neighbour is queued or being canonicalised.
+    //Called from the thread spawning the tasks, so neither count can rise meanwhile. Tasks
+    //queue their neighbours before they stop being counted, so reading the counts before the
+    //queue (and this before processingQueue) misses nothing still in flight.
+    template <int dim>
+    static bool pipelineIdle() {
+        if (expanding().load() != 0) {
+            return false;
+        }
+    #ifdef PIPELINE
+        return canonicalising().load() == 0 && neighbourQueue<dim>().empty();
+    #else
+        return true;
+    #endif
+    }
+
+    //Adds a signature owned by this rank to the visited set, queueing it if new
+    template <class U>
+    static void addSig(std::unordered_set<std::string>& sigSet, U& processingQueue, const std::string& s) {
+        STATS_START(dedup);
+        #pragma omp critical(sig)
+        {
+            if (sigSet.count(s) == 0) { //New triangulation
+                sigSet.insert(s);
+                MemoryGovernor::add(MemoryGovernor::VisitedSet, MemoryGovernor::entryBytes(s));
+                processingQueue.push(s);
+            } else {
+                STATS_ADD(Stats::Duplicates, 1);
+            }
+        }
+        STATS_STOP(dedup, Stats::Dedup);
+    }
+
+    //(NUMA_SHARDS) As above, handing the signature to the shard's NUMA domain
+    template <class U>
+    static void addSig(NumaShards& sigSet, U& processingQueue, const std::string& s) {
+        STATS_START(dedup);
+        sigSet.submit(s, processingQueue);
+        STATS_STOP(dedup, Stats::Dedup);
+    }
+
+    //Whether no signatures are waiting to be handed between NUMA domains
+    static bool shardsIdle(std::unordered_set<std::string>&) {
+        return true;
+    }
+
+    static bool shardsIdle(NumaShards& sigSet) {
+        return sigSet.idle();
+    }
+
+    //Moves the visited signatures out of the set, freeing it as they are collected
+    static void release(std::unordered_set<std::string>& sigSet, std::vector<std::string>& out) {
+        while (! sigSet.empty()) {
+            out.push_back(std::move(sigSet.extract(sigSet.begin()).value()));
+        }
+    }
+
+    static void release(NumaShards& sigSet, std::vector<std::string>& out) {
+        sigSet.release(out);
+    }
+
+    //(PIPELINE) Canonicalisation stage: canonicalises and routes a batch of queued neighbours
+    template <int dim, class T, class U>
+    static void canonicaliseNeighbours(T& sigSet, U& processingQueue, std::vector<std::queue<std::string>>& sendBatch, int rank) {
+        Triangulation<dim>* tri;
+        for (int i = 0; i < pipelineBatch && neighbourQueue<dim>().tryPop(tri); i++) {
+            queueSig<dim>(sigSet, processingQueue, tri, sendBatch, rank);
+        }
+    }
+
     static void debug_info(std::string s) {
         int rank;
         MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -43,13 +141,7 @@ class SearchParallel {
             char* buffer = (char*)malloc(sizeof(char) * count);
             MPI_Recv(buffer, count, MPI_CHAR, MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
             std::string recvSig = std::string(buffer);
-            #pragma omp critical(sig) 
-            {
-                if (sigSet.count(recvSig) == 0) { 
-                    sigSet.insert(recvSig);
-                    processingQueue.push(recvSig);
-                }
-            }
+            addSig(sigSet, processingQueue, recvSig);
             MPI_Iprobe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &flag, &status);
         }        
         return flag;
@@ -60,6 +152,7 @@ class SearchParallel {
     static bool check_status(T& sigSet, U& processingQueue, std::vector<bool>& states, int rank, int nComp) {
         bool res = false;    
         states[rank] = true;
+        STATS_START(mpi);
         #pragma omp critical(communication)
         {
             receiveStatus(states, rank, nComp);
@@ -73,11 +166,14 @@ class SearchParallel {
             for (int i = 0; i < nComp; i++) {
                 if (i != rank) {
                     MPI_Bsend(&data, 1, MPI_INT, i, tag1, MPI_COMM_WORLD);
+                    STATS_ADD(Stats::MessagesSent, 1);
+                    STATS_ADD(Stats::BytesSent, sizeof(int));
                 }
             }
             MPI_Buffer_detach(&b, &bufsize);
             free(b);
         }
+        STATS_STOP(mpi, Stats::Mpi);
         for (bool state : states) {
             if (state == false) {
                 res = true;
@@ -92,6 +188,7 @@ class SearchParallel {
     static void processNodeParallel(T& sigSet, U& processingQueue, int tLimit, std::vector<std::queue<std::string>>& sendBatch,
             std::vector<bool>& states, int rank, int nComp) {
         //MPI receive into queue -> number of times until empty
+        STATS_START(mpi);
         #pragma omp critical(communication)
         {
             if (receive<dim>(sigSet, processingQueue)) {
@@ -106,6 +203,8 @@ class SearchParallel {
                     for (int i = 0; i < nComp; i++) {
                         if (i != rank) {
                             MPI_Bsend(&data, 1, MPI_INT, i, tag1, MPI_COMM_WORLD);
+                            STATS_ADD(Stats::MessagesSent, 1);
+                            STATS_ADD(Stats::BytesSent, sizeof(int));
                         }
                     }
                     MPI_Buffer_detach(&b, &bufsize);
@@ -113,6 +212,10 @@ class SearchParallel {
                 }
             }
         }
+        STATS_STOP(mpi, Stats::Mpi);
+    #ifdef NUMA_SHARDS
+        sigSet.drain(processingQueue);
+    #endif
         std::string sig;
         #pragma omp critical(sig)
         {
@@ -125,37 +228,62 @@ class SearchParallel {
         if (sig.size() == 0) {
             return;
         }
+        STATS_ADD(Stats::NodesExpanded, 1);
+        STATS_START(decode);
         Triangulation<dim>* t = Triangulation<dim>::fromIsoSig(sig);
-        std::vector<Triangulation<dim>*> adj = Search::getPachnerMoves(t, tLimit);
+        STATS_STOP(decode, Stats::Decode);
+    #if defined(PIPELINE) && ! defined(PACHNER_GRAPH)
+        //Each neighbour is queued as soon as it is built, and a full queue means canonicalisation
+        //is behind, so help it rather than build more; at most pipelineCapacity neighbours are held.
+        //Moves time here includes the canonicalisation helped with.
+        STATS_START(moves);
+        Search::forEachPachnerMove(t, tLimit, [&](Triangulation<dim>* tri, int) {
+            while (! neighbourQueue<dim>().tryPush(tri)) {
+                canonicaliseNeighbours<dim>(sigSet, processingQueue, sendBatch, rank);
+            }
+        });
+        STATS_STOP(moves, Stats::Moves);
+    #else
+        STATS_START(moves);
+        std::vector<int> faces;
+        std::vector<Triangulation<dim>*> adj = Search::getPachnerMoves(t, tLimit, &faces);
+        STATS_STOP(moves, Stats::Moves);
         //Convert all to sigs and add to processingQueue + sigSet
+        std::vector<std::string> neighbours;
         for (auto tri : adj) {
-            queueSig<dim>(sigSet, processingQueue, tri, sendBatch, rank);
+            //(PACHNER_GRAPH) Edges need the neighbours' signatures here, so the pipeline is bypassed
+            std::string s = queueSig<dim>(sigSet, processingQueue, tri, sendBatch, rank);
+        #ifdef PACHNER_GRAPH
+            neighbours.push_back(s);
+        #endif
         }
+    #endif
+    #ifdef PACHNER_GRAPH
+        PachnerGraph::record(sig, neighbours, faces, rank);
+    #endif
         //Deleting triangulation occurs after it has been processed
         delete t;      
     }
 
-    //General function for queuing signature (multiple machines)
+    //General function for queuing signature (multiple machines), returning the signature
     template <int dim, class T, class U>
-    static void queueSig(T& sigSet, U& processingQueue, Triangulation<dim>* tri, std::vector<std::queue<std::string>>& sendBatch, int rank) {
+    static std::string queueSig(T& sigSet, U& processingQueue, Triangulation<dim>* tri, std::vector<std::queue<std::string>>& sendBatch, int rank) {
+        STATS_START(canonicalise);
         std::string s = IsoSig::computeSignature(tri);
+        STATS_STOP(canonicalise, Stats::Canonicalise);
         delete tri;
-        int hash = std::hash<std::string>{}(s) % sendBatch.size();
+        int hash = SigHash::owner(s, sendBatch.size());
         //Compute locally
         if (hash == rank) {
-            #pragma omp critical(sig)
-            {
-                if (sigSet.count(s) == 0) { //New triangulation
-                    sigSet.insert(s);
-                    processingQueue.push(s);
-                } 
-            }
+            addSig(sigSet, processingQueue, s);
         //Send Externally
         } else {
             //Second condition for finishing processing
+            STATS_START(mpi);
             #pragma omp critical(communication)
             {
                 sendBatch[hash].push(s);
+                MemoryGovernor::add(MemoryGovernor::SendBatch, MemoryGovernor::stringBytes(s));
                 if (!sendBatch[hash].empty()) {
                     int size;
                     MPI_Pack_size( maxLength, MPI_CHAR, MPI_COMM_WORLD, &size );
@@ -165,28 +293,43 @@ class SearchParallel {
                     while (sendBatch[hash].size() > 0) {
                         std::string item = sendBatch[hash].front();
                         sendBatch[hash].pop();
+                        MemoryGovernor::add(MemoryGovernor::SendBatch, -(int64_t)MemoryGovernor::stringBytes(item));
                         MPI_Bsend(&item[0], item.size() + 1, MPI_CHAR, hash, tag, MPI_COMM_WORLD);
+                        STATS_ADD(Stats::MessagesSent, 1);
+                        STATS_ADD(Stats::BytesSent, item.size() + 1);
                     }
                     MPI_Buffer_detach(&b, &bufsize);
                     free(b);
                 }
             }
+            STATS_STOP(mpi, Stats::Mpi);
         }
+        return s;
     }
 public:
+    //Returns the number of signatures this rank found. MPI is initialised and finalised
+    //here unless the caller has already initialised it.
     template <int dim>
-    static void searchExhaustiveParallel(std::vector<std::string> & start, int tLimit) {
-        MPI_Init(NULL, NULL);
+    static size_t searchExhaustiveParallel(std::vector<std::string> & start, int tLimit) {
+        int initialised;
+        MPI_Initialized(&initialised);
+        if (! initialised) {
+            MPI_Init(NULL, NULL);
+        }
         int nComp;
         int rank;
         MPI_Comm_size(MPI_COMM_WORLD, &nComp);
         MPI_Comm_rank(MPI_COMM_WORLD, &rank);
         std::vector<std::queue<std::string>> sendBatch(nComp);
+    #ifdef NUMA_SHARDS
+        NumaShards sigSet(nComp);
+    #else
         std::unordered_set<std::string> sigSet;
+    #endif
         std::vector<bool> states(nComp, false);
         //Main application here:
         //(MPI)Must receive into this queue when message received
-        std::queue<std::string> processingQueue;
+        Frontier processingQueue;
         //Slight unneeded overhead for now (recomputes signature)
         if (rank == 0) {
             for (auto name : start) {
@@ -196,14 +339,56 @@ public:
         #pragma omp parallel
         #pragma omp single
         {
-            while (!processingQueue.empty() || check_status<dim>(sigSet, processingQueue, states, rank, nComp)) {
+            //In-flight work is checked first, as it adds to processingQueue until it is counted idle
+            while (!pipelineIdle<dim>() || !shardsIdle(sigSet) || !processingQueue.empty() || check_status<dim>(sigSet, processingQueue, states, rank, nComp)) {
+            #ifdef NUMA_SHARDS
+                sigSet.drain(processingQueue);
+            #endif
+            #ifdef PIPELINE
+                //Canonicalisation and expansion are scheduled as separate tasks. Expansion
+                //pauses while the neighbour queue is over half full.
+                if (! neighbourQueue<dim>().empty()) {
+                    canonicalising()++;
+                    #pragma omp task
+                    {
+                        canonicaliseNeighbours<dim>(sigSet, processingQueue, sendBatch, rank);
+                        canonicalising()--;
+                    }
+                }
+                if (neighbourQueue<dim>().size() < neighbourQueue<dim>().capacity() / 2) {
+                    expanding()++;
+                    #pragma omp task
+                    {
+                        processNodeParallel<dim>(sigSet, processingQueue, tLimit, sendBatch, states, rank, nComp);
+                        expanding()--;
+                    }
+                }
+            #else
+                expanding()++;
                 #pragma omp task
                 {
                     processNodeParallel<dim>(sigSet, processingQueue, tLimit, sendBatch, states, rank, nComp);
+                    expanding()--;
+                }
+            #endif
+                //Frontier entries are stored more compactly as memory runs short
+                if (MemoryGovernor::due()) {
+                    MemoryGovernor::update();
                 }
+            #ifdef SEARCH_STATS
+                if (Stats::due()) {
+                    size_t depth;
+                    #pragma omp critical(sig)
+                    depth = processingQueue.size();
+                    Stats::report(rank, depth);
+                }
+            #endif
             }
             #pragma omp taskwait
         }        
+    #ifdef SEARCH_STATS
+        Stats::summary(rank, processingQueue.size());
+    #endif
         //Individual sizes
         std::cout << sigSet.size() << " processor:" << rank << std::endl;
         //Gather sizes
@@ -221,11 +406,29 @@ public:
             }
             std::cout << "Cumulative:" << sum << std::endl;
         }
+    #if defined(CENSUS_INDEX) || defined(PACHNER_GRAPH)
+        //Each rank indexes the signatures it owns
+        std::vector<std::string> sigs;
+        sigs.reserve(count);
+        release(sigSet, sigs);
+        std::sort(sigs.begin(), sigs.end());
+    #endif
+    #ifdef CENSUS_INDEX
+        if (! CensusIndex::write(CensusIndex::path("census", rank), sigs, rank, nComp)) {
+            std::cerr << "Failed to write census index Rank:" << rank << std::endl;
+        }
+    #endif
+    #ifdef PACHNER_GRAPH
+        PachnerGraph::write<dim>(sigs, rank, nComp);
+    #endif
         //Finished
-        MPI_Finalize();
+        if (! initialised) {
+            MPI_Finalize();
+        }
         if (rank == 0) {
             free(res);
         }
+        return count;
     }
 };
 
@@ -0,0 +1,410 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "isosig.h"
+#include "search.h"
+#include "census.h"
+
+#include<triangulation/dim3.h>
+#include<triangulation/dim4.h>
+#include<triangulation/detail/triangulation.h>
+
+using namespace regina;
+
+/* Long-lived request loop (#define SERVICE in main.cc), so tools can avoid paying
+ * process startup for every small query. Requests are lines read from stdin, or
+ * from every client of a Unix socket if a path is given:
+ *     canon <sig>                  -> ok <canonical signature>
+ *     neighbours <sig> <tLimit>    -> ok <count> <canonical signatures...>
+ *     member <sig>                 -> ok 1|0 (whether the loaded census contains it)
+ *     quit                         -> ok, then the client's connection is closed
+ * and failures are answered with "error <reason>". Each client gets one reply line
+ * per request, in order. On stdin quit therefore stops the service, while a socket
+ * client only ends its own connection. Each round collects the lines that all clients
+ * have sent and answers them as one batch with an OpenMP loop. The thread pool and the
+ * mapped census (census.<rank>.idx) stay alive between rounds. MPI is not initialised.
+ * Client descriptors are non-blocking: replies wait in a per-client output buffer
+ * until the client can take them, and a client with maxPending bytes of input or
+ * output waiting is not read from or answered until it catches up. A line longer
+ * than maxLine is answered with an error and ends that client's connection.
+*/
+template <int dim>
+class Service {
+private:
+    //Requests answered in one round; the rest wait in client buffers for the next
+    static const size_t maxBatch = 4096;
+    static const size_t readSize = 1 << 16;
+    //Longest request line
+    static const size_t maxLine = 1 << 16;
+    //Input or output waiting for a client beyond which it is not read from or answered
+    static const size_t maxPending = 1 << 20;
+
+    struct Client {
+        int in;
+        int out;
+        std::string buffer;
+        //Replies not yet taken by the client
+        std::string output;
+        //False once the client has closed its end, or no more is read from it
+        bool open;
+        //Whether it sent a line longer than maxLine, still to be answered
+        bool overlong;
+        //Whether it sent quit, so no later requests are answered
+        bool done;
+        //Whether a write failed, so nothing more can be sent
+        bool broken;
+
+        Client(int in, int out) : in(in), out(out), open(true), overlong(false), done(false), broken(false) {}
+    };
+
+    struct Request {
+        size_t client;
+        std::string line;
+        std::string reply;
+    };
+
+    std::vector<CensusIndex*> census;
+    std::vector<Client> clients;
+    //Client whose lines are collected first, rotated so none is starved
+    size_t first;
+
+    static std::string canonicalise(const std::string& sig) {
+        Triangulation<dim>* triangulation = Triangulation<dim>::fromIsoSig(sig);
+        if (! triangulation) {
+            return "";
+        }
+        std::string ans = IsoSig::computeSignature(triangulation);
+        delete triangulation;
+        return ans;
+    }
+
+    //First word of a request line, which names its command
+    static std::string command(const std::string& line) {
+        std::istringstream words(line);
+        std::string command;
+        words >> command;
+        return command;
+    }
+
+    std::string answer(const std::string& line) const {
+        std::istringstream words(line);
+        std::string command;
+        std::string sig;
+        words >> command >> sig;
+        if (command == "quit") {
+            return "ok";
+        }
+        if (command == "canon") {
+            std::string canonical = canonicalise(sig);
+            return canonical.empty() ? "error invalid signature" : "ok " + canonical;
+        }
+        if (command == "member") {
+            if (census.empty()) {
+                return "error no census loaded";
+            }
+            std::string canonical = canonicalise(sig);
+            if (canonical.empty()) {
+                return "error invalid signature";
+            }
+            return CensusIndex::shardFor(census, canonical)->contains(canonical) ? "ok 1" : "ok 0";
+        }
+        if (command == "neighbours") {
+            int tLimit;
+            if (! (words >> tLimit)) {
+                return "error missing size limit";
+            }
+            Triangulation<dim>* triangulation = Triangulation<dim>::fromIsoSig(sig);
+            if (! triangulation) {
+                return "error invalid signature";
+            }
+            std::vector<std::string> sigs;
+            for (auto tri : Search::getPachnerMoves(triangulation, tLimit)) {
+                sigs.push_back(IsoSig::computeSignature(tri));
+                delete tri;
+            }
+            delete triangulation;
+            std::sort(sigs.begin(), sigs.end());
+            sigs.erase(std::unique(sigs.begin(), sigs.end()), sigs.end());
+            std::string ans = "ok " + std::to_string(sigs.size());
+            for (auto& s : sigs) {
+                ans += " " + s;
+            }
+            return ans;
+        }
+        return "error unknown command";
+    }
+
+    static bool wouldBlock() {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    //Returns the previous flags, so they can be restored
+    static int setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags >= 0) {
+            fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        }
+        return flags;
+    }
+
+    //Reads what the client has sent, closing its input at the end or after an overlong line
+    static void readFrom(Client& client) {
+        char chunk[readSize];
+        ssize_t n = read(client.in, chunk, sizeof(chunk));
+        if (n < 0 && wouldBlock()) {
+            return;
+        }
+        if (n <= 0) {
+            client.open = false;
+            //An unterminated last line is still a request
+            if (! client.buffer.empty() && client.buffer.back() != '\n') {
+                client.buffer += '\n';
+            }
+            return;
+        }
+        size_t lineStart = client.buffer.rfind('\n') + 1;
+        client.buffer.append(chunk, n);
+        //Complete lines before an overlong one are still answered
+        while (true) {
+            size_t end = client.buffer.find('\n', lineStart);
+            size_t length = (end == std::string::npos ? client.buffer.size() : end) - lineStart;
+            if (length > maxLine) {
+                client.buffer.erase(lineStart);
+                client.open = false;
+                client.overlong = true;
+                return;
+            }
+            if (end == std::string::npos) {
+                return;
+            }
+            lineStart = end + 1;
+        }
+    }
+
+    //Writes as much queued output as the client takes without blocking
+    static void flush(Client& client) {
+        size_t written = 0;
+        while (written < client.output.size()) {
+            ssize_t n = write(client.out, client.output.data() + written, client.output.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && wouldBlock()) {
+                break;
+            }
+            if (n <= 0) {
+                client.broken = true;
+                client.open = false;
+                client.buffer.clear();
+                client.output.clear();
+                return;
+            }
+            written += n;
+        }
+        client.output.erase(0, written);
+    }
+
+    //Whether the client has requests that can be answered in this round
+    static bool answerable(const Client& client) {
+        return ! client.broken && client.output.size() < maxPending &&
+            (client.overlong || client.buffer.find('\n') != std::string::npos);
+    }
+
+    //Whether the client can be dropped: nothing more to read, answer or send
+    static bool finished(const Client& client) {
+        return client.broken || (! client.open && ! answerable(client) && client.output.empty());
+    }
+
+    //Takes complete lines from the client buffers, at most maxBatch in total
+    void collect(std::vector<Request>& batch) {
+        for (size_t i = 0; i < clients.size() && batch.size() < maxBatch; i++) {
+            size_t c = (first + i) % clients.size();
+            if (! answerable(clients[c])) {
+                continue;
+            }
+            std::string& buffer = clients[c].buffer;
+            size_t start = 0;
+            size_t end;
+            while (batch.size() < maxBatch && (end = buffer.find('\n', start)) != std::string::npos) {
+                //Surrounding whitespace, including telnet's \r, is not part of the request
+                size_t first = buffer.find_first_not_of(" \t\r", start);
+                size_t last = buffer.find_last_not_of(" \t\r", end);
+                std::string line = first < end ? buffer.substr(first, last - first + 1) : "";
+                batch.push_back({c, line, ""});
+                start = end + 1;
+            }
+            buffer.erase(0, start);
+            if (clients[c].overlong && batch.size() < maxBatch && buffer.find('\n') == std::string::npos) {
+                batch.push_back({c, "", "error line too long"});
+                clients[c].overlong = false;
+            }
+        }
+        first++;
+    }
+
+    bool pending() const {
+        for (auto& client : clients) {
+            if (answerable(client)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int serve(int listener) {
+        //A client leaving mid-reply must not end the service
+        signal(SIGPIPE, SIG_IGN);
+        std::vector<Request> batch;
+        while (listener >= 0 || ! clients.empty()) {
+            std::vector<pollfd> fds;
+            //Client of each entry of fds, and whether the entry waits to write
+            std::vector<std::pair<size_t, bool>> owners;
+            for (size_t c = 0; c < clients.size(); c++) {
+                if (clients[c].open && clients[c].buffer.size() < maxPending) {
+                    fds.push_back({clients[c].in, POLLIN, 0});
+                    owners.push_back({c, false});
+                }
+                if (! clients[c].output.empty()) {
+                    fds.push_back({clients[c].out, POLLOUT, 0});
+                    owners.push_back({c, true});
+                }
+            }
+            if (listener >= 0) {
+                fds.push_back({listener, POLLIN, 0});
+            }
+            //Lines already buffered are answered without waiting for more input
+            if (poll(fds.data(), fds.size(), pending() ? 0 : -1) < 0 && errno != EINTR) {
+                perror("poll");
+                return 1;
+            }
+            for (size_t i = 0; i < owners.size(); i++) {
+                Client& client = clients[owners[i].first];
+                if (! fds[i].revents) {
+                    continue;
+                }
+                if (owners[i].second) {
+                    flush(client);
+                } else if (client.open) {
+                    readFrom(client);
+                }
+            }
+            if (listener >= 0 && fds.back().revents) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    setNonBlocking(fd);
+                    clients.emplace_back(fd, fd);
+                }
+            }
+
+            collect(batch);
+            #pragma omp parallel for schedule(dynamic)
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (batch[i].reply.empty()) {
+                    batch[i].reply = answer(batch[i].line);
+                }
+            }
+            for (auto& request : batch) {
+                Client& client = clients[request.client];
+                if (client.done || client.broken) {
+                    continue;
+                }
+                client.output += request.reply + "\n";
+                //quit ends only this client's connection, once its replies are sent
+                if (command(request.line) == "quit") {
+                    client.done = true;
+                    client.open = false;
+                    client.overlong = false;
+                    client.buffer.clear();
+                }
+            }
+            batch.clear();
+            for (auto& client : clients) {
+                if (! client.output.empty()) {
+                    flush(client);
+                }
+            }
+
+            //Drop clients which have closed and have no requests or replies left
+            for (size_t c = clients.size(); c-- > 0;) {
+                if (finished(clients[c])) {
+                    if (listener >= 0) {
+                        close(clients[c].in);
+                    }
+                    clients.erase(clients.begin() + c);
+                }
+            }
+        }
+        return 0;
+    }
+
+public:
+    //Loads the census written by a -DCENSUS_INDEX search, if there is one
+    Service(const std::string& censusBase) : census(CensusIndex::openAll(censusBase)), first(0) {}
+
+    ~Service() {
+        for (auto shard : census) {
+            delete shard;
+        }
+    }
+
+    Service(const Service&) = delete;
+    Service& operator=(const Service&) = delete;
+
+    //Serves stdin and stdout, or the clients of a Unix socket at socketPath if it is not empty
+    int run(const std::string& socketPath) {
+        if (socketPath.empty()) {
+            int inFlags = setNonBlocking(0);
+            int outFlags = setNonBlocking(1);
+            clients.emplace_back(0, 1);
+            int status = serve(-1);
+            //stdin and stdout may be shared with other processes
+            if (inFlags >= 0) {
+                fcntl(0, F_SETFL, inFlags);
+            }
+            if (outFlags >= 0) {
+                fcntl(1, F_SETFL, outFlags);
+            }
+            return status;
+        }
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            std::cerr << "Socket path too long" << std::endl;
+            return 1;
+        }
+        std::strcpy(address.sun_path, socketPath.c_str());
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socketPath.c_str());
+        if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0
+                || listen(listener, SOMAXCONN) != 0) {
+            perror("socket");
+            if (listener >= 0) {
+                close(listener);
+            }
+            return 1;
+        }
+        setNonBlocking(listener);
+        int status = serve(listener);
+        for (auto& client : clients) {
+            close(client.in);
+        }
+        close(listener);
+        unlink(socketPath.c_str());
+        return status;
+    }
+};
+#endif
@@ -0,0 +1,33 @@
+#ifndef SIG_HASH_H
+#define SIG_HASH_H
+#include <string>
+#include <cstdint>
+
+/* 64-bit FNV-1a hash of a signature, which picks the rank owning it during a
+ * search and so the census shard and graph rows it is written to. Unlike
+ * std::hash its values do not depend on the standard library, so files written
+ * by one build are looked up correctly by another. Files record id, and must
+ * be rewritten if the hash ever changes.
+*/
+class SigHash {
+private:
+    SigHash();
+
+public:
+    static const uint32_t id = 1;
+
+    static uint64_t hash(const std::string& sig) {
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : sig) {
+            h = (h ^ (unsigned char)c) * 1099511628211ULL;
+        }
+        return h;
+    }
+
+    //Rank (or shard) owning sig among n
+    static int owner(const std::string& sig, int n) {
+        return hash(sig) % n;
+    }
+};
+
+#endif
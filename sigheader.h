@@ -0,0 +1,50 @@
+#ifndef SIG_HEADER_H
+#define SIG_HEADER_H
+#include <string>
+#include <cstddef>
+
+#include<triangulation/detail/isosig-impl.h>
+
+using namespace regina;
+using namespace detail;
+
+/* Header of the signature of a connected component, as Regina writes it: the
+ * number of simplices in one character, or for 63 or more simplices an escape
+ * character, the number of characters per integer and the number in that many
+ * characters. Every later integer of the signature uses the same width.
+*/
+class SigHeader {
+private:
+    SigHeader();
+
+public:
+    //Characters per integer for a component of nSimp simplices
+    static unsigned charsPerInt(size_t nSimp) {
+        if (nSimp < 63) {
+            return 1;
+        }
+        unsigned nChars = 0;
+        for (size_t tmp = nSimp; tmp > 0; tmp >>= 6) {
+            ++nChars;
+        }
+        return nChars;
+    }
+
+    //Characters in the header, and so the position of the first facet action
+    static size_t length(size_t nSimp) {
+        return nSimp < 63 ? 1 : 2 + charsPerInt(nSimp);
+    }
+
+    //Appends the header, returning the characters per integer
+    static unsigned append(std::string& ans, size_t nSimp) {
+        unsigned nChars = charsPerInt(nSimp);
+        if (nSimp >= 63) {
+            ans += IsoSigHelper::SCHAR(63);
+            ans += IsoSigHelper::SCHAR(nChars);
+        }
+        IsoSigHelper::SAPPEND(ans, nSimp, nChars);
+        return nChars;
+    }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef STATS_H
+#define STATS_H
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "threadslots.h"
+
+/* Search instrumentation, enabled by compiling with -DSEARCH_STATS (make stats).
+ * Each thread adds to its own cache line of counters (see ThreadSlots); the
+ * reporter sums them when a periodic line or the final summary is written to
+ * stats.<rank>.jsonl, which each run starts afresh. Without SEARCH_STATS the macros below expand to nothing.
+*/
+#ifdef SEARCH_STATS
+#define STATS_ADD(counter, n) Stats::add(counter, n)
+#define STATS_START(name) auto stats_##name = Stats::now()
+#define STATS_STOP(name, timer) Stats::addTime(timer, stats_##name)
+#else
+#define STATS_ADD(counter, n)
+#define STATS_START(name)
+#define STATS_STOP(name, timer)
+#endif
+
+class Stats {
+public:
+    enum Counter {
+        NodesExpanded,
+        //Neighbours by the dimension of the face the Pachner move is performed on
+        Neighbours0, Neighbours1, Neighbours2, Neighbours3, Neighbours4,
+        Duplicates,
+        Signatures,
+        Candidates,
+        MessagesSent,
+        BytesSent,
+        nCounters
+    };
+    enum Timer {
+        Decode,
+        Moves,
+        Canonicalise,
+        Dedup,
+        Mpi,
+        nTimers
+    };
+
+private:
+    //Seconds between periodic lines
+    static const int interval = 1;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> counters[nCounters];
+        std::atomic<uint64_t> nanos[nTimers];
+    };
+
+    Stats();
+
+    typedef ThreadSlots<Slot> Slots;
+
+    static std::chrono::steady_clock::time_point& lastReport() {
+        static std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+        return last;
+    }
+
+    static std::chrono::steady_clock::time_point& started() {
+        static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return start;
+    }
+
+    static std::string counterName(int counter) {
+        static const char* names[nCounters] = {"nodes", "neighbours_0", "neighbours_1", "neighbours_2",
+            "neighbours_3", "neighbours_4", "duplicates", "signatures", "candidates",
+            "messages_sent", "bytes_sent"};
+        return names[counter];
+    }
+
+    static std::string timerName(int timer) {
+        static const char* names[nTimers] = {"decode_ns", "moves_ns", "canonicalise_ns", "dedup_ns", "mpi_ns"};
+        return names[timer];
+    }
+
+    static void write(int rank, size_t queueDepth, const char* type) {
+        uint64_t counters[nCounters] = {};
+        uint64_t nanos[nTimers] = {};
+        for (int i = 0; i < Slots::maxThreads; i++) {
+            for (int c = 0; c < nCounters; c++) {
+                counters[c] += Slots::at(i).counters[c].load(std::memory_order_relaxed);
+            }
+            for (int t = 0; t < nTimers; t++) {
+                nanos[t] += Slots::at(i).nanos[t].load(std::memory_order_relaxed);
+            }
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started()).count();
+        //The first line of a run replaces the previous run's file
+        static bool truncate = true;
+        std::ofstream out("stats." + std::to_string(rank) + ".jsonl", truncate ? std::ofstream::trunc : std::ofstream::app);
+        truncate = false;
+        out << "{\"type\":\"" << type << "\",\"rank\":" << rank << ",\"elapsed_s\":" << elapsed
+            << ",\"queue_depth\":" << queueDepth;
+        for (int c = 0; c < nCounters; c++) {
+            out << ",\"" << counterName(c) << "\":" << counters[c];
+        }
+        for (int t = 0; t < nTimers; t++) {
+            out << ",\"" << timerName(t) << "\":" << nanos[t];
+        }
+        out << "}" << std::endl;
+    }
+
+public:
+    static std::chrono::steady_clock::time_point now() {
+        return std::chrono::steady_clock::now();
+    }
+
+    static void add(Counter counter, uint64_t n) {
+        Slots::local().counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static void addTime(Timer timer, std::chrono::steady_clock::time_point start) {
+        uint64_t n = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count();
+        Slots::local().nanos[timer].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    static Counter neighbours(int faceDim) {
+        return (Counter)(Neighbours0 + faceDim);
+    }
+
+    //Whether a periodic line is due; called from a single thread
+    static bool due() {
+        started();
+        return now() - lastReport() >= std::chrono::seconds(interval);
+    }
+
+    static void report(int rank, size_t queueDepth) {
+        lastReport() = now();
+        write(rank, queueDepth, "periodic");
+    }
+
+    static void summary(int rank, size_t queueDepth) {
+        write(rank, queueDepth, "summary");
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef THREAD_SLOTS_H
+#define THREAD_SLOTS_H
+#include <atomic>
+
+/* Fixed table of cache-line aligned per-thread counters, one table per Slot type.
+ * A thread takes the next slot on first use and keeps it for its lifetime. Once
+ * more than maxThreads threads have been seen (more cores, or OpenMP pools
+ * recreated), slots are shared. Updates therefore use a relaxed fetch_add, a
+ * locked read-modify-write on x86, but uncontended while the slot has a single
+ * writer since the cache line stays with that thread. Readers sum the table on
+ * demand.
+*/
+template <class Slot>
+class ThreadSlots {
+public:
+    static const int maxThreads = 256;
+
+private:
+    ThreadSlots();
+
+    static Slot* slots() {
+        static Slot slots[maxThreads] = {};
+        return slots;
+    }
+
+public:
+    //Slot of the calling thread, assigned on first use
+    static Slot& local() {
+        static std::atomic<int> nextSlot(0);
+        thread_local int slot = nextSlot.fetch_add(1) % maxThreads;
+        return slots()[slot];
+    }
+
+    static Slot& at(int i) {
+        return slots()[i];
+    }
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef VARINT_H
+#define VARINT_H
+#include <string>
+#include <istream>
+#include <cstdint>
+
+/* LEB128 variable length integers, as used by the census index, the frontier's
+ * packed records and the Pachner graph's edge files: 7 bits per byte, least
+ * significant first, with the high bit set on every byte but the last.
+*/
+class Varint {
+private:
+    Varint();
+
+public:
+    static void put(std::string& buffer, uint64_t value) {
+        while (value >= 0x80) {
+            buffer += (char)(value | 0x80);
+            value >>= 7;
+        }
+        buffer += (char)value;
+    }
+
+    //Reads the varint at p, advancing p past it
+    static uint64_t get(const char*& p) {
+        uint64_t value = 0;
+        for (int shift = 0; ; shift += 7) {
+            unsigned char byte = *p++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+    }
+
+    static uint64_t get(std::istream& in) {
+        uint64_t value = 0;
+        for (int shift = 0; ; shift += 7) {
+            int byte = in.get();
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                return value;
+            }
+        }
+    }
+};
+
+#endif
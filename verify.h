@@ -0,0 +1,302 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "isosig.h"
+
+#include<triangulation/dim3.h>
+#include<triangulation/dim4.h>
+#include<triangulation/detail/triangulation.h>
+#include<triangulation/detail/isosig-impl.h>
+
+using namespace regina;
+using namespace detail;
+
+/* Differential verification of IsoSig::computeSignature against slower references.
+ * Each trial takes one input triangulation and, using its own seeded generator:
+ *  - runs the reference (the unoptimised Regina walk, with no tables, batching
+ *    or pruning) from every simplex and every vertex labelling, independently of
+ *    getCandidates, and checks that computeSignature is one of those walks;
+ *  - checks that a random relabelling has the same signature;
+ *  - re-glues one facet at random and checks that the signatures agree exactly
+ *    when Regina's isIsomorphicTo finds an isomorphism, and exactly when the
+ *    smallest reference walks agree, so candidate pruning never separates
+ *    isomorphic triangulations or merges different ones.
+ * Failures are shrunk by removing gluings and simplices while they still fail,
+ * and written out as Regina isoSigs together with the trial's seed.
+*/
+class Verify {
+private:
+    static const unsigned seed = 4242;
+    //Trials run per input triangulation
+    static const int trials = 16;
+    Verify();
+
+    enum Check {
+        Reference,
+        Relabelling,
+        Regluing,
+        None
+    };
+
+    static std::string checkName(Check check) {
+        static const char* names[] = {"reference", "relabelling", "regluing", "none"};
+        return names[check];
+    }
+
+    //Regina's isoSigFrom as it was before the fast paths, operating on Perm objects
+    template <int dim>
+    static std::string referenceIsoSigFrom(Triangulation<dim>* triangulation, size_t simp,
+            const Perm<dim+1>& vertices) {
+        size_t nSimp = triangulation->size();
+        std::vector<char> facetAction;
+        std::vector<size_t> joinDest;
+        std::vector<typename Perm<dim+1>::Index> joinGluing;
+        std::vector<ptrdiff_t> image(nSimp, -1);
+        std::vector<ptrdiff_t> preImage(nSimp, -1);
+        std::vector<Perm<dim+1>> vertexMap(nSimp);
+
+        image[simp] = 0;
+        vertexMap[simp] = vertices.inverse();
+        preImage[0] = simp;
+        size_t nextUnusedSimp = 1;
+        size_t simpImg;
+        for (simpImg = 0; simpImg < nSimp && preImage[simpImg] >= 0; ++simpImg) {
+            size_t simpSrc = preImage[simpImg];
+            const Simplex<dim>* s = triangulation->simplex(simpSrc);
+            for (unsigned facetImg = 0; facetImg <= dim; ++facetImg) {
+                unsigned facetSrc = vertexMap[simpSrc].preImageOf(facetImg);
+                if (! s->adjacentSimplex(facetSrc)) {
+                    facetAction.push_back(0);
+                    continue;
+                }
+                size_t dest = s->adjacentSimplex(facetSrc)->index();
+                if (image[dest] >= 0)
+                    if (image[dest] < image[simpSrc] ||
+                            (dest == simpSrc &&
+                            vertexMap[simpSrc][s->adjacentFacet(facetSrc)]
+                            < vertexMap[simpSrc][facetSrc])) {
+                        continue;
+                    }
+                if (image[dest] < 0) {
+                    image[dest] = nextUnusedSimp++;
+                    preImage[image[dest]] = dest;
+                    vertexMap[dest] = vertexMap[simpSrc] *
+                        s->adjacentGluing(facetSrc).inverse();
+                    facetAction.push_back(1);
+                    continue;
+                }
+                joinDest.push_back(image[dest]);
+                joinGluing.push_back((vertexMap[dest] *
+                    s->adjacentGluing(facetSrc) * vertexMap[simpSrc].inverse()).index());
+                facetAction.push_back(2);
+            }
+        }
+
+        std::string ans;
+        size_t nCompSimp = simpImg;
+        unsigned nChars;
+        if (nCompSimp < 63)
+            nChars = 1;
+        else {
+            nChars = 0;
+            for (size_t tmp = nCompSimp; tmp > 0; tmp >>= 6)
+                ++nChars;
+            ans = IsoSigHelper::SCHAR(63);
+            ans += IsoSigHelper::SCHAR(nChars);
+        }
+        IsoSigHelper::SAPPEND(ans, nCompSimp, nChars);
+        for (size_t i = 0; i < facetAction.size(); i += 3)
+            IsoSigHelper::SAPPENDTRITS(ans, facetAction.data() + i,
+                (facetAction.size() >= i + 3 ? 3 : facetAction.size() - i));
+        for (size_t i = 0; i < joinDest.size(); ++i)
+            IsoSigHelper::SAPPEND(ans, joinDest[i], nChars);
+        for (size_t i = 0; i < joinGluing.size(); ++i)
+            IsoSigHelper::SAPPEND(ans, joinGluing[i], IsoSigHelper::CHARS_PER_PERM<dim>());
+        return ans;
+    }
+
+    //Reference walks from every simplex and every labelling of its vertices, sorted
+    template <int dim>
+    static std::vector<std::string> referenceSignatures(Triangulation<dim>* triangulation) {
+        std::vector<std::string> ans;
+        for (size_t simp = 0; simp < triangulation->size(); simp++) {
+            for (typename Perm<dim + 1>::Index perm = 0; perm < Perm<dim + 1>::nPerms; perm++) {
+                ans.push_back(referenceIsoSigFrom(triangulation, simp, Perm<dim + 1>::atIndex(perm)));
+            }
+        }
+        std::sort(ans.begin(), ans.end());
+        return ans;
+    }
+
+    //Copy of triangulation with shuffled simplices and random vertex labels
+    template <int dim>
+    static Triangulation<dim>* relabel(Triangulation<dim>* triangulation, std::mt19937& rng) {
+        size_t n = triangulation->size();
+        std::vector<size_t> order(n);
+        std::vector<Perm<dim + 1>> perms(n);
+        for (size_t i = 0; i < n; i++) {
+            order[i] = i;
+            perms[i] = Perm<dim + 1>::atIndex(rng() % Perm<dim + 1>::nPerms);
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        Triangulation<dim>* ans = new Triangulation<dim>();
+        for (size_t i = 0; i < n; i++) {
+            ans->newSimplex();
+        }
+        for (size_t i = 0; i < n; i++) {
+            const Simplex<dim>* s = triangulation->simplex(i);
+            for (int facet = 0; facet <= dim; facet++) {
+                Simplex<dim>* image = ans->simplex(order[i]);
+                if (! s->adjacentSimplex(facet) || image->adjacentSimplex(perms[i][facet])) {
+                    continue;
+                }
+                size_t j = s->adjacentSimplex(facet)->index();
+                image->join(perms[i][facet], ans->simplex(order[j]),
+                    perms[j] * s->adjacentGluing(facet) * perms[i].inverse());
+            }
+        }
+        return ans;
+    }
+
+    //Copy of triangulation with one gluing replaced by a random gluing of the same facets
+    template <int dim>
+    static Triangulation<dim>* reglue(Triangulation<dim>* triangulation, std::mt19937& rng) {
+        Triangulation<dim>* ans = new Triangulation<dim>(*triangulation, false);
+        std::vector<std::pair<size_t, int>> glued;
+        for (size_t i = 0; i < ans->size(); i++) {
+            for (int facet = 0; facet <= dim; facet++) {
+                if (ans->simplex(i)->adjacentSimplex(facet)) {
+                    glued.emplace_back(i, facet);
+                }
+            }
+        }
+        if (glued.empty()) {
+            return ans;
+        }
+        auto choice = glued[rng() % glued.size()];
+        Simplex<dim>* s = ans->simplex(choice.first);
+        Simplex<dim>* adj = s->adjacentSimplex(choice.second);
+        int adjFacet = s->adjacentFacet(choice.second);
+        Perm<dim + 1> gluing;
+        do {
+            gluing = Perm<dim + 1>::atIndex(rng() % Perm<dim + 1>::nPerms);
+        } while (gluing[choice.second] != adjFacet);
+        s->unjoin(choice.second);
+        s->join(choice.second, adj, gluing);
+        return ans;
+    }
+
+    //Runs the checks of one trial, returning the first that fails
+    template <int dim>
+    static Check check(Triangulation<dim>* triangulation, unsigned trialSeed, size_t& candidates) {
+        std::mt19937 rng(trialSeed);
+        std::string sig = IsoSig::computeSignature(triangulation);
+        candidates += IsoSig::getCandidates(triangulation).size();
+        std::vector<std::string> reference = referenceSignatures(triangulation);
+        if (! std::binary_search(reference.begin(), reference.end(), sig)) {
+            return Reference;
+        }
+        Triangulation<dim>* relabelled = relabel(triangulation, rng);
+        bool same = (IsoSig::computeSignature(relabelled) == sig);
+        candidates += IsoSig::getCandidates(relabelled).size();
+        delete relabelled;
+        if (! same) {
+            return Relabelling;
+        }
+        Triangulation<dim>* reglued = reglue(triangulation, rng);
+        bool isomorphic = (bool) triangulation->isIsomorphicTo(*reglued);
+        bool sameReference = (referenceSignatures(reglued).front() == reference.front());
+        same = (IsoSig::computeSignature(reglued) == sig);
+        candidates += IsoSig::getCandidates(reglued).size();
+        delete reglued;
+        if (isomorphic != same || sameReference != same) {
+            return Regluing;
+        }
+        return None;
+    }
+
+    //Greedily removes gluings, then simplices, while the same check keeps failing
+    template <int dim>
+    static Triangulation<dim>* minimise(Triangulation<dim>* triangulation, unsigned trialSeed, Check failure) {
+        Triangulation<dim>* current = new Triangulation<dim>(*triangulation, false);
+        size_t ignored = 0;
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (size_t i = 0; i < current->size() && ! progress; i++) {
+                for (int facet = 0; facet <= dim && ! progress; facet++) {
+                    if (! current->simplex(i)->adjacentSimplex(facet)) {
+                        continue;
+                    }
+                    Triangulation<dim>* smaller = new Triangulation<dim>(*current, false);
+                    smaller->simplex(i)->unjoin(facet);
+                    if (smaller->isConnected() && check(smaller, trialSeed, ignored) == failure) {
+                        delete current;
+                        current = smaller;
+                        progress = true;
+                    } else {
+                        delete smaller;
+                    }
+                }
+            }
+            for (size_t i = 0; i < current->size() && ! progress && current->size() > 1; i++) {
+                Triangulation<dim>* smaller = new Triangulation<dim>(*current, false);
+                smaller->removeSimplexAt(i);
+                if (smaller->isConnected() && check(smaller, trialSeed, ignored) == failure) {
+                    delete current;
+                    current = smaller;
+                    progress = true;
+                } else {
+                    delete smaller;
+                }
+            }
+        }
+        return current;
+    }
+
+public:
+    //Verifies the number isoSigs read from in, writing counterexamples to out
+    //and a throughput summary to stdout. Returns the number of failures.
+    template <int dim>
+    static int run(int number, std::ifstream& in, std::ofstream& out) {
+        std::vector<std::string> names;
+        for (int x = 0; x < number; x++) {
+            std::string name;
+            in >> name;
+            names.push_back(name);
+        }
+        size_t candidates = 0;
+        int failures = 0;
+        auto start = std::chrono::steady_clock::now();
+        #pragma omp parallel for schedule(dynamic) reduction(+:candidates, failures)
+        for (int job = 0; job < (int)names.size() * trials; job++) {
+            Triangulation<dim>* triangulation = Triangulation<dim>::fromIsoSig(names[job / trials]);
+            if (! triangulation) {
+                continue;
+            }
+            unsigned trialSeed = seed + job;
+            Check failure = check(triangulation, trialSeed, candidates);
+            if (failure != None) {
+                failures++;
+                Triangulation<dim>* small = minimise(triangulation, trialSeed, failure);
+                #pragma omp critical(output)
+                out << checkName(failure) << " " << names[job / trials] << " seed:" << trialSeed
+                    << " minimised:" << small->isoSig() << std::endl;
+                delete small;
+            }
+            delete triangulation;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Trials:" << names.size() * trials << " Failures:" << failures
+            << " Candidates/s:" << (long long)(candidates / std::max(seconds, 1e-9)) << std::endl;
+        return failures;
+    }
+};
+#endif